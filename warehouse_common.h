@@ -0,0 +1,2480 @@
+// Code shared by the two warehouse programs, warehouse_system.cpp and
+// warehouse_system_b.cpp. Each is a single translation unit that includes
+// this header first; what differs between them lives in the .cpp files.
+#ifndef WAREHOUSE_COMMON_H
+#define WAREHOUSE_COMMON_H
+
+// std::filesystem and string_view need C++17
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "Build with C++17 or later (-std=c++17)"
+#endif
+#include <iostream>
+#include <string>
+#include <limits>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <iterator>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <future>
+#include <string_view>
+#include <random>
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WAREHOUSE_NAME_SSE2
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define WAREHOUSE_NAME_AVX2  // compiled for AVX2, picked at run time
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+#ifdef __linux__
+#include <csignal>
+#include <pthread.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+using namespace std;
+
+// Node for Stack and Queue. 32 bytes on LP64: three links and the id, where
+// the string-named node with the same links took 72.
+struct ItemNode {
+    ItemNode* next;
+    ItemNode* prev;      // neighbour towards top/front, for O(1) unlink
+    ItemNode* nextSame;  // next node with the same item, in search order
+    uint32_t itemId;     // interned name, see SkuDictionary
+    int quantity;
+
+    ItemNode(uint32_t id = 0,int qty = 1) : next(nullptr), prev(nullptr), nextSame(nullptr),
+                                             itemId(id), quantity(qty) {}
+};
+
+// Forward iterator over nodes linked through next
+class NodeIterator {
+private:
+    const ItemNode* node;
+
+public:
+    explicit NodeIterator(const ItemNode* node) : node(node) {}
+
+    const ItemNode& operator*() const { return *node; }
+    const ItemNode* operator->() const { return node; }
+
+    NodeIterator& operator++() {
+        node = node->next;
+        return *this;
+    }
+
+    bool operator!=(const NodeIterator& other) const { return node != other.node; }
+};
+
+// Interns item names once and hands out dense 32-bit ids, so the containers
+// compare integers and names are only turned back into strings for display
+// and saving. Lookup is an open-addressing hash table with linear probing.
+class SkuDictionary {
+private:
+    struct Slot {
+        size_t hash;
+        uint32_t id;
+        bool used;
+
+        Slot() : hash(0), id(0), used(false) {}
+    };
+
+    vector<Slot> slots;
+    vector<string> names;
+
+    // Returns the slot holding name, or the empty slot where it belongs
+    size_t probe(const string& name, size_t h) const {
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        while (slots[i].used && (slots[i].hash != h || names[slots[i].id] != name)) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow() {
+        vector<Slot> old;
+        old.swap(slots);
+        slots.resize(old.size() * 2);
+        size_t mask = slots.size() - 1;
+        for (const Slot& s : old) {
+            if (s.used) {
+                size_t i = s.hash & mask;
+                while (slots[i].used) i = (i + 1) & mask;
+                slots[i] = s;
+            }
+        }
+    }
+
+public:
+    static constexpr uint32_t NO_ID = 0xFFFFFFFFu;
+
+    SkuDictionary() : slots(1024) {}
+
+    // Id for name, adding it on first sight
+    uint32_t intern(const string& name) {
+        if ((names.size() + 1) * 4 > slots.size() * 3) {
+            grow();
+        }
+        size_t h = hash<string>()(name);
+        Slot& s = slots[probe(name, h)];
+        if (!s.used) {
+            s.used = true;
+            s.hash = h;
+            s.id = static_cast<uint32_t>(names.size());
+            names.push_back(name);
+        }
+        return s.id;
+    }
+
+    // Id for name, or NO_ID if it was never interned
+    uint32_t lookup(const string& name) const {
+        const Slot& s = slots[probe(name, hash<string>()(name))];
+        return s.used ? s.id : NO_ID;
+    }
+
+    const string& name(uint32_t id) const { return names[id]; }
+
+    size_t size() const { return names.size(); }
+};
+
+// The dictionary the calling thread interns into: the shared one unless the
+// thread installed its own, as the checkpoint writer does for its replica
+inline SkuDictionary*& threadDictionary() {
+    static SkuDictionary shared;
+    thread_local SkuDictionary* current = &shared;
+    return current;
+}
+
+inline SkuDictionary& skuDictionary() {
+    return *threadDictionary();
+}
+
+// Per-container index from item id to the nodes carrying it. Nodes with the
+// same id are chained through nextSame in the order a top-to-bottom (stack)
+// or front-to-rear (queue) scan would reach them. Ids are dense, so the
+// table is a plain array indexed by id. Chain order follows the container
+// links, so nodes carry no sequence number.
+class NameIndex {
+private:
+    struct Chain {
+        ItemNode* head;
+        ItemNode* tail;
+
+        Chain() : head(nullptr), tail(nullptr) {}
+    };
+
+    vector<Chain> chains;
+    bool newestFirst;  // true for the stack, false for the queue
+
+    Chain& chainFor(uint32_t id) {
+        if (id >= chains.size()) {
+            chains.resize(max<size_t>(id + 1, chains.size() * 2));
+        }
+        return chains[id];
+    }
+
+public:
+    explicit NameIndex(bool newestFirst) : newestFirst(newestFirst) {}
+
+    void clear() {
+        chains.clear();
+    }
+
+    // First node with this id in search order, or nullptr
+    ItemNode* find(uint32_t id) const {
+        return id < chains.size() ? chains[id].head : nullptr;
+    }
+
+    // Index a node just pushed onto the top of the stack or the rear of the queue
+    void insertNewest(ItemNode* node) {
+        Chain& c = chainFor(node->itemId);
+        if (c.head == nullptr) {
+            node->nextSame = nullptr;
+            c.head = c.tail = node;
+        } else if (newestFirst) {
+            node->nextSame = c.head;
+            c.head = node;
+        } else {
+            node->nextSame = nullptr;
+            c.tail->nextSame = node;
+            c.tail = node;
+        }
+    }
+
+    // Index a node already linked somewhere in the container, as a rename
+    // does. Its chain predecessor is the nearest node with the same item
+    // towards the top/front, found by walking prev; renames are rare, and
+    // the walk saves a sequence number in every node.
+    void insertLinked(ItemNode* node) {
+        Chain& c = chainFor(node->itemId);
+        ItemNode* p = node->prev;
+        while (p != nullptr && p->itemId != node->itemId) {
+            p = p->prev;
+        }
+        if (p == nullptr) {
+            node->nextSame = c.head;
+            c.head = node;
+            if (c.tail == nullptr) c.tail = node;
+        } else {
+            node->nextSame = p->nextSame;
+            p->nextSame = node;
+            if (c.tail == p) c.tail = node;
+        }
+    }
+
+    void erase(ItemNode* node) {
+        Chain& c = chains[node->itemId];
+        if (c.head == node) {
+            c.head = node->nextSame;
+            if (c.head == nullptr) c.tail = nullptr;
+        } else {
+            ItemNode* p = c.head;
+            while (p->nextSame != node) {
+                p = p->nextSame;
+            }
+            p->nextSame = node->nextSame;
+            if (c.tail == node) c.tail = p;
+        }
+        node->nextSame = nullptr;
+    }
+};
+
+// Slab allocator shared by the stack and the queue. Nodes are carved out
+// of fixed-size slabs and recycled through a free list linked by next.
+// ItemNode is trivially destructible, so releasing a slab is one delete[].
+class NodePool {
+private:
+    static constexpr size_t SLAB_NODES = 1024;
+
+    vector<ItemNode*> slabs;
+    ItemNode* freeList;
+    size_t freeCount;
+    size_t liveCount;
+    size_t peakLive;
+
+    void addSlab() {
+        ItemNode* slab = new ItemNode[SLAB_NODES];
+        slabs.push_back(slab);
+        for (size_t i = 0; i < SLAB_NODES; i++) {
+            slab[i].next = freeList;
+            freeList = &slab[i];
+        }
+        freeCount += SLAB_NODES;
+    }
+
+public:
+    NodePool() : freeList(nullptr), freeCount(0), liveCount(0), peakLive(0) {}
+
+    ~NodePool() {
+        releaseAll();
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ItemNode* allocate(uint32_t id, int qty) {
+        if (freeList == nullptr) {
+            addSlab();
+        }
+        ItemNode* node = freeList;
+        freeList = node->next;
+        freeCount--;
+        if (++liveCount > peakLive) peakLive = liveCount;
+
+        *node = ItemNode(id, qty);
+        return node;
+    }
+
+    void release(ItemNode* node) {
+        node->next = freeList;
+        freeList = node;
+        freeCount++;
+        liveCount--;
+    }
+
+    // Drop every slab at once. Any node still linked into a container is
+    // invalidated, so the containers must be reset alongside.
+    void releaseAll() {
+        for (ItemNode* slab : slabs) {
+            delete[] slab;
+        }
+        slabs.clear();
+        freeList = nullptr;
+        freeCount = 0;
+        liveCount = 0;
+    }
+
+    size_t slabsInUse() const { return slabs.size(); }
+    size_t freeNodes() const { return freeCount; }
+    size_t liveNodes() const { return liveCount; }
+    size_t peakNodes() const { return peakLive; }
+};
+
+#ifndef WAREHOUSE_VECTOR_STACK
+
+// Stack class for incoming items (LIFO)
+class InventoryStack {
+private:
+    ItemNode* top;
+    NodePool& pool;
+    NameIndex index;
+    long long units;  // running totals, so counting is O(1)
+    size_t nodes;
+
+    // Unlink a node from anywhere in the stack and free it
+    void remove(ItemNode* node) {
+        if (node->prev != nullptr) node->prev->next = node->next;
+        else top = node->next;
+        if (node->next != nullptr) node->next->prev = node->prev;
+        index.erase(node);
+        pool.release(node);
+        nodes--;
+    }
+
+public:
+    typedef NodeIterator const_iterator;
+
+    explicit InventoryStack(NodePool& pool) : top(nullptr), pool(pool), index(true),
+                                             units(0), nodes(0) {}
+
+    ~InventoryStack() {
+        clear();
+    }
+
+    // Return every node to the pool; one step per node, whatever the quantities
+    void clear() {
+        while (top != nullptr) {
+            ItemNode* next = top->next;
+            pool.release(top);
+            top = next;
+        }
+        index.clear();
+        units = 0;
+        nodes = 0;
+    }
+
+    // Iterates from the top of the stack to the bottom
+    const_iterator begin() const { return const_iterator(top); }
+    const_iterator end() const { return const_iterator(nullptr); }
+
+    long long unitCount() const { return units; }
+    size_t entryCount() const { return nodes; }
+
+    bool isEmpty() const {
+        return top == nullptr;
+    }
+
+    void push(uint32_t itemId, int qty = 1)
+    {
+        units += qty;
+        if (!isEmpty() && top->itemId == itemId)
+        {
+            top->quantity += qty;
+            return;
+
+        }
+        ItemNode* newNode = pool.allocate(itemId, qty);
+        newNode->next = top;
+        if (top != nullptr) top->prev = newNode;
+        top = newNode;
+        index.insertNewest(newNode);
+        nodes++;
+    }
+
+    uint32_t pop() {
+    if (isEmpty()) {
+        throw runtime_error("No items in inventory to process!");
+    }
+
+    ItemNode* temp = top;
+    uint32_t id = temp->itemId;
+    units--;
+
+    if (temp->quantity > 1) {
+        temp->quantity--;
+    } else {
+        top = top->next;
+        if (top != nullptr) top->prev = nullptr;
+        index.erase(temp);
+        pool.release(temp);
+        nodes--;
+    }
+
+    return id;}
+
+    // Quantity in the topmost entry for this item, or 0 if it is not stocked
+    int quantityOf(uint32_t itemId) const {
+        ItemNode* node = index.find(itemId);
+        return node != nullptr ? node->quantity : 0;
+    }
+
+    // Take qty units from the topmost entry for this item, dropping it when it empties
+    void take(uint32_t itemId, int qty) {
+        ItemNode* node = index.find(itemId);
+        node->quantity -= qty;
+        units -= qty;
+        if (node->quantity == 0) {
+            remove(node);
+        }
+    }
+
+    // Unlink the topmost node for this item and hand it over whole, so it
+    // can be relinked into the shipping queue without a free/allocate
+    ItemNode* detach(uint32_t itemId) {
+        ItemNode* node = index.find(itemId);
+        if (node->prev != nullptr) node->prev->next = node->next;
+        else top = node->next;
+        if (node->next != nullptr) node->next->prev = node->prev;
+        index.erase(node);
+        node->next = node->prev = nullptr;
+        units -= node->quantity;
+        nodes--;
+        return node;
+    }
+
+    // Give the topmost entry for oldId a new item and quantity
+    bool reassign(uint32_t oldId, uint32_t newId, int newQty) {
+        ItemNode* node = index.find(oldId);
+        if (node == nullptr) return false;
+        index.erase(node);
+        units += newQty - node->quantity;
+        node->itemId = newId;
+        node->quantity = newQty;
+        index.insertLinked(node);
+        return true;
+    }
+
+
+    uint32_t peek() const {
+         if (isEmpty()) {
+            throw runtime_error("No incoming items.");
+        }
+        return top->itemId;
+    }
+
+    void displayAll() const {
+    if (isEmpty()) {
+        cout << "Inventory is empty." << endl;
+        return;
+    }
+    cout << "Inventory items (top to bottom): ";
+    ItemNode* current = top;
+    while (current != nullptr) {
+        cout << skuDictionary().name(current->itemId) <<  "(" << current->quantity << ") ";
+        current = current->next;
+    }
+    cout << endl;
+}
+
+};
+
+#else
+
+// Stack class for incoming items (LIFO), stored contiguously in a vector
+// whose back is the top of the stack. Scans stream through memory and
+// push/pop never allocate per entry. Removing from the middle leaves a
+// tombstone (quantity 0) that scans skip; once tombstones make up half the
+// stack, the live entries are packed together again.
+class InventoryStack {
+public:
+    struct Entry {
+        uint32_t itemId;
+        int quantity;       // 0 marks a tombstone
+        size_t nextSame;    // next slot below holding the same item, or NO_SLOT
+    };
+
+private:
+    static constexpr size_t NO_SLOT = ~size_t(0);
+    static constexpr size_t MIN_COMPACT = 64;
+
+    vector<Entry> entries;
+    size_t tombstones;
+    long long units;  // running totals, so counting is O(1)
+    size_t nodes;
+    vector<size_t> heads;   // per-item topmost slot, chained downwards
+
+    void linkTop(size_t slot) {
+        Entry& e = entries[slot];
+        if (e.itemId >= heads.size()) {
+            heads.resize(max<size_t>(e.itemId + 1, heads.size() * 2), NO_SLOT);
+        }
+        e.nextSame = heads[e.itemId];
+        heads[e.itemId] = slot;
+    }
+
+    // Insert a slot into its item's chain, keeping top-to-bottom order
+    void linkOrdered(size_t slot) {
+        Entry& e = entries[slot];
+        if (e.itemId >= heads.size()) {
+            heads.resize(max<size_t>(e.itemId + 1, heads.size() * 2), NO_SLOT);
+        }
+        size_t& head = heads[e.itemId];
+        if (head == NO_SLOT || slot > head) {
+            e.nextSame = head;
+            head = slot;
+        } else {
+            size_t p = head;
+            while (entries[p].nextSame != NO_SLOT && entries[p].nextSame > slot) {
+                p = entries[p].nextSame;
+            }
+            e.nextSame = entries[p].nextSame;
+            entries[p].nextSame = slot;
+        }
+    }
+
+    // Turn a slot into a tombstone and trim dead entries off the top
+    void kill(size_t slot) {
+        heads[entries[slot].itemId] = entries[slot].nextSame;
+        entries[slot].quantity = 0;
+        tombstones++;
+        nodes--;
+        while (!entries.empty() && entries.back().quantity == 0) {
+            entries.pop_back();
+            tombstones--;
+        }
+        if (tombstones >= MIN_COMPACT && tombstones * 2 >= entries.size()) {
+            compact();
+        }
+    }
+
+    // Slide live entries down over the tombstones and rebuild the chains
+    void compact() {
+        size_t out = 0;
+        for (size_t in = 0; in < entries.size(); in++) {
+            if (entries[in].quantity != 0) {
+                entries[out++] = entries[in];
+            }
+        }
+        entries.resize(out);
+        tombstones = 0;
+        fill(heads.begin(), heads.end(), NO_SLOT);
+        for (size_t slot = 0; slot < entries.size(); slot++) {
+            linkTop(slot);
+        }
+    }
+
+public:
+    // Iterates from the top of the stack to the bottom
+    class const_iterator {
+    private:
+        const vector<Entry>* entries;
+        size_t slot;  // one past the entry being visited
+
+        void skipTombstones() {
+            while (slot > 0 && (*entries)[slot - 1].quantity == 0) slot--;
+        }
+
+    public:
+        const_iterator(const vector<Entry>* entries, size_t slot) : entries(entries), slot(slot) {
+            skipTombstones();
+        }
+
+        const Entry& operator*() const { return (*entries)[slot - 1]; }
+        const Entry* operator->() const { return &(*entries)[slot - 1]; }
+
+        const_iterator& operator++() {
+            slot--;
+            skipTombstones();
+            return *this;
+        }
+
+        bool operator!=(const const_iterator& other) const { return slot != other.slot; }
+    };
+
+    // Entries are stored inline, so the shared node pool is not used
+    explicit InventoryStack(NodePool&) : tombstones(0), units(0), nodes(0) {}
+
+    void clear() {
+        entries.clear();
+        heads.clear();
+        tombstones = 0;
+        units = 0;
+        nodes = 0;
+    }
+
+    const_iterator begin() const { return const_iterator(&entries, entries.size()); }
+    const_iterator end() const { return const_iterator(&entries, 0); }
+
+    long long unitCount() const { return units; }
+    size_t entryCount() const { return nodes; }
+
+    bool isEmpty() const {
+        return entries.empty();
+    }
+
+    void push(uint32_t itemId, int qty = 1) {
+        units += qty;
+        if (!isEmpty() && entries.back().itemId == itemId) {
+            entries.back().quantity += qty;
+            return;
+        }
+        Entry e;
+        e.itemId = itemId;
+        e.quantity = qty;
+        entries.push_back(e);
+        linkTop(entries.size() - 1);
+        nodes++;
+    }
+
+    uint32_t pop() {
+        if (isEmpty()) {
+            throw runtime_error("No items in inventory to process!");
+        }
+
+        Entry& e = entries.back();
+        uint32_t id = e.itemId;
+        units--;
+        if (e.quantity > 1) {
+            e.quantity--;
+        } else {
+            kill(entries.size() - 1);
+        }
+        return id;
+    }
+
+    // Quantity in the topmost entry for this item, or 0 if it is not stocked
+    int quantityOf(uint32_t itemId) const {
+        if (itemId >= heads.size() || heads[itemId] == NO_SLOT) return 0;
+        return entries[heads[itemId]].quantity;
+    }
+
+    // Take qty units from the topmost entry for this item, dropping it when it empties
+    void take(uint32_t itemId, int qty) {
+        size_t slot = heads[itemId];
+        entries[slot].quantity -= qty;
+        units -= qty;
+        if (entries[slot].quantity == 0) {
+            kill(slot);
+        }
+    }
+
+    // Give the topmost entry for oldId a new item and quantity
+    bool reassign(uint32_t oldId, uint32_t newId, int newQty) {
+        if (quantityOf(oldId) == 0) return false;
+        size_t slot = heads[oldId];
+        heads[oldId] = entries[slot].nextSame;
+        units += newQty - entries[slot].quantity;
+        entries[slot].itemId = newId;
+        entries[slot].quantity = newQty;
+        linkOrdered(slot);
+        return true;
+    }
+
+    uint32_t peek() const {
+        if (isEmpty()) {
+            throw runtime_error("No incoming items.");
+        }
+        return entries.back().itemId;
+    }
+
+    void displayAll() const {
+        if (isEmpty()) {
+            cout << "Inventory is empty." << endl;
+            return;
+        }
+        cout << "Inventory items (top to bottom): ";
+        for (const Entry& e : *this) {
+            cout << skuDictionary().name(e.itemId) <<  "(" << e.quantity << ") ";
+        }
+        cout << endl;
+    }
+};
+
+#endif
+
+#ifndef WAREHOUSE_RING_QUEUE
+
+// Queue class for outgoing shipments (FIFO)
+class ShippingQueue {
+private:
+    ItemNode* front;
+    ItemNode* rear;
+    NodePool& pool;
+    NameIndex index;
+    long long units;  // running totals, so counting is O(1)
+    size_t nodes;
+
+    // Unlink a node from anywhere in the queue and free it
+    void remove(ItemNode* node) {
+        if (node->prev != nullptr) node->prev->next = node->next;
+        else front = node->next;
+        if (node->next != nullptr) node->next->prev = node->prev;
+        else rear = node->prev;
+        index.erase(node);
+        pool.release(node);
+        nodes--;
+    }
+
+public:
+    typedef NodeIterator const_iterator;
+
+    explicit ShippingQueue(NodePool& pool) : front(nullptr), rear(nullptr), pool(pool), index(false),
+                                            units(0), nodes(0) {}
+
+    ~ShippingQueue() {
+        clear();
+    }
+
+    // Return every node to the pool; one step per node, whatever the quantities
+    void clear() {
+        while (front != nullptr) {
+            ItemNode* next = front->next;
+            pool.release(front);
+            front = next;
+        }
+        rear = nullptr;
+        index.clear();
+        units = 0;
+        nodes = 0;
+    }
+
+    const_iterator begin() const { return const_iterator(front); }
+    const_iterator end() const { return const_iterator(nullptr); }
+
+    long long unitCount() const { return units; }
+    size_t entryCount() const { return nodes; }
+
+    bool isEmpty() const {
+        return front == nullptr;
+    }
+
+    void enqueue(uint32_t itemId,int qty = 1) {
+    units += qty;
+    if (!isEmpty() && rear->itemId == itemId) {
+        rear->quantity += qty;
+        return;
+    }
+    ItemNode* newNode = pool.allocate(itemId, qty);
+    if (isEmpty()) {
+        front = rear = newNode;
+    } else {
+        newNode->prev = rear;
+        rear->next = newNode;
+        rear = newNode;
+    }
+    index.insertNewest(newNode);
+    nodes++;
+}
+
+    // Link a node detached from the inventory onto the rear
+    void enqueueNode(ItemNode* node) {
+        units += node->quantity;
+        if (!isEmpty() && rear->itemId == node->itemId) {
+            rear->quantity += node->quantity;
+            pool.release(node);
+            return;
+        }
+        if (isEmpty()) {
+            front = rear = node;
+        } else {
+            node->prev = rear;
+            rear->next = node;
+            rear = node;
+        }
+        index.insertNewest(node);
+        nodes++;
+    }
+
+    uint32_t dequeue() {
+        if (isEmpty()) {
+            throw runtime_error("No items to ship.!");
+        }
+
+        ItemNode* temp = front;
+        uint32_t id = temp->itemId;
+        units--;
+
+        if (temp->quantity > 1) {
+        temp->quantity--;
+    } else {
+        front = front->next;
+        if (front == nullptr) rear = nullptr;
+        else front->prev = nullptr;
+        index.erase(temp);
+        pool.release(temp);
+        nodes--;
+    }
+
+    return id;
+    }
+
+    // Quantity in the front-most entry for this item, or 0 if it is not queued
+    int quantityOf(uint32_t itemId) const {
+        ItemNode* node = index.find(itemId);
+        return node != nullptr ? node->quantity : 0;
+    }
+
+    // Take qty units from the front-most entry for this item, dropping it when it empties
+    void take(uint32_t itemId, int qty) {
+        ItemNode* node = index.find(itemId);
+        node->quantity -= qty;
+        units -= qty;
+        if (node->quantity == 0) {
+            remove(node);
+        }
+    }
+
+    // Quantity of the rear entry, or 0 if the queue is empty
+    int rearQuantity() const {
+        return isEmpty() ? 0 : rear->quantity;
+    }
+
+    // Take qty units from the rear entry, dropping it when it empties
+    void takeBack(int qty) {
+        rear->quantity -= qty;
+        units -= qty;
+        if (rear->quantity == 0) {
+            remove(rear);
+        }
+    }
+
+    // Give the front-most entry for oldId a new item and quantity
+    bool reassign(uint32_t oldId, uint32_t newId, int newQty) {
+        ItemNode* node = index.find(oldId);
+        if (node == nullptr) return false;
+        index.erase(node);
+        units += newQty - node->quantity;
+        node->itemId = newId;
+        node->quantity = newQty;
+        index.insertLinked(node);
+        return true;
+    }
+
+
+    uint32_t peek() const {
+        if (isEmpty()) {
+            throw runtime_error("No items in shipping queue.");
+        }
+        return front->itemId;
+    }
+
+    uint32_t peekBack() const {
+        if (isEmpty()) {
+            throw runtime_error("No items in shipping queue.");
+        }
+        return rear->itemId;
+    }
+
+    void displayAll() const {
+    if (isEmpty()) {
+        cout << "Shipping queue is empty." << endl;
+        return;
+    }
+    cout << "Shipping queue items (front to rear): ";
+    ItemNode* current = front;
+    while (current != nullptr) {
+        cout << skuDictionary().name(current->itemId) <<  "(" << current->quantity << ") ";
+        current = current->next;
+    }
+    cout << endl;
+}
+
+};
+
+#else
+
+// Queue class for outgoing shipments (FIFO), stored in a growable ring of
+// fixed-size chunks instead of linked nodes. Entries are addressed by an
+// absolute position that never changes until compaction. Removing from the
+// middle leaves a tombstone (quantity 0) that scans skip; once tombstones
+// make up half the queue, the live entries are packed together again.
+class ShippingQueue {
+public:
+    struct Entry {
+        uint32_t itemId;
+        int quantity;       // 0 marks a tombstone
+        uint64_t nextSame;  // next position holding the same item, or NO_POS
+    };
+
+private:
+    static constexpr unsigned CHUNK_BITS = 10;
+    static constexpr uint64_t CHUNK_SIZE = uint64_t(1) << CHUNK_BITS;
+    static constexpr uint64_t NO_POS = ~uint64_t(0);
+    static constexpr size_t MIN_COMPACT = 64;
+
+    struct Chain {
+        uint64_t head;
+        uint64_t tail;
+
+        Chain() : head(NO_POS), tail(NO_POS) {}
+    };
+
+    vector<Entry*> chunks;  // ring of chunk pointers, size is a power of two
+    uint64_t head;          // position of the front entry
+    uint64_t tail;          // one past the rear entry
+    size_t tombstones;
+    long long units;  // running totals, so counting is O(1)
+    size_t nodes;
+    vector<Chain> chains;   // per-item positions, front to rear
+
+    Entry& at(uint64_t pos) {
+        return chunks[(pos >> CHUNK_BITS) & (chunks.size() - 1)][pos & (CHUNK_SIZE - 1)];
+    }
+
+    const Entry& at(uint64_t pos) const {
+        return chunks[(pos >> CHUNK_BITS) & (chunks.size() - 1)][pos & (CHUNK_SIZE - 1)];
+    }
+
+    // Make sure position tail has a chunk behind it, doubling the ring if needed
+    void reserveTail() {
+        uint64_t firstChunk = head >> CHUNK_BITS;
+        uint64_t lastChunk = tail >> CHUNK_BITS;
+        if (lastChunk - firstChunk + 1 > chunks.size()) {
+            vector<Entry*> grown(chunks.size() * 2, nullptr);
+            for (uint64_t c = firstChunk; c < lastChunk; c++) {
+                Entry*& slot = chunks[c & (chunks.size() - 1)];
+                grown[c & (grown.size() - 1)] = slot;
+                slot = nullptr;
+            }
+            for (Entry* spare : chunks) {
+                delete[] spare;
+            }
+            chunks.swap(grown);
+        }
+        Entry*& chunk = chunks[lastChunk & (chunks.size() - 1)];
+        if (chunk == nullptr) {
+            chunk = new Entry[CHUNK_SIZE];
+        }
+    }
+
+    void linkBack(uint64_t pos) {
+        Entry& e = at(pos);
+        if (e.itemId >= chains.size()) {
+            chains.resize(max<size_t>(e.itemId + 1, chains.size() * 2));
+        }
+        Chain& c = chains[e.itemId];
+        e.nextSame = NO_POS;
+        if (c.head == NO_POS) c.head = pos;
+        else at(c.tail).nextSame = pos;
+        c.tail = pos;
+    }
+
+    // Insert a position into its item's chain, keeping front-to-rear order
+    void linkOrdered(uint64_t pos) {
+        Entry& e = at(pos);
+        if (e.itemId >= chains.size()) {
+            chains.resize(max<size_t>(e.itemId + 1, chains.size() * 2));
+        }
+        Chain& c = chains[e.itemId];
+        if (c.head == NO_POS || pos > c.tail) {
+            linkBack(pos);
+        } else if (pos < c.head) {
+            e.nextSame = c.head;
+            c.head = pos;
+        } else {
+            uint64_t p = c.head;
+            while (at(p).nextSame < pos) {
+                p = at(p).nextSame;
+            }
+            e.nextSame = at(p).nextSame;
+            at(p).nextSame = pos;
+        }
+    }
+
+    // Drop the front-most position of an item from its chain
+    void unlinkHead(uint32_t itemId) {
+        Chain& c = chains[itemId];
+        c.head = at(c.head).nextSame;
+        if (c.head == NO_POS) c.tail = NO_POS;
+    }
+
+    // Drop the rear-most position of an item from its chain; chains only
+    // link forwards, so this walks the item's entries
+    void unlinkTail(uint32_t itemId) {
+        Chain& c = chains[itemId];
+        if (c.head == c.tail) {
+            c = Chain();
+            return;
+        }
+        uint64_t p = c.head;
+        while (at(p).nextSame != c.tail) {
+            p = at(p).nextSame;
+        }
+        at(p).nextSame = NO_POS;
+        c.tail = p;
+    }
+
+    // Turn a position into a tombstone and trim dead entries off either end
+    void kill(uint64_t pos) {
+        at(pos).quantity = 0;
+        tombstones++;
+        nodes--;
+        while (head < tail && at(head).quantity == 0) {
+            head++;
+            tombstones--;
+        }
+        while (tail > head && at(tail - 1).quantity == 0) {
+            tail--;
+            tombstones--;
+        }
+        if (head == tail) {
+            head = tail = 0;
+        } else if (tombstones >= MIN_COMPACT && tombstones * 2 >= tail - head) {
+            compact();
+        }
+    }
+
+    // Slide live entries forward over the tombstones and rebuild the chains
+    void compact() {
+        uint64_t out = head;
+        for (uint64_t in = head; in < tail; in++) {
+            if (at(in).quantity != 0) {
+                if (out != in) at(out) = at(in);
+                out++;
+            }
+        }
+        tail = out;
+        tombstones = 0;
+        for (Chain& c : chains) {
+            c = Chain();
+        }
+        for (uint64_t pos = head; pos < tail; pos++) {
+            linkBack(pos);
+        }
+    }
+
+public:
+    class const_iterator {
+    private:
+        const ShippingQueue* queue;
+        uint64_t pos;
+
+        void skipTombstones() {
+            while (pos < queue->tail && queue->at(pos).quantity == 0) pos++;
+        }
+
+    public:
+        const_iterator(const ShippingQueue* queue, uint64_t pos) : queue(queue), pos(pos) {
+            skipTombstones();
+        }
+
+        const Entry& operator*() const { return queue->at(pos); }
+        const Entry* operator->() const { return &queue->at(pos); }
+
+        const_iterator& operator++() {
+            pos++;
+            skipTombstones();
+            return *this;
+        }
+
+        bool operator!=(const const_iterator& other) const { return pos != other.pos; }
+    };
+
+    // Entries are stored inline, so the shared node pool is not used
+    explicit ShippingQueue(NodePool&) : chunks(4, nullptr), head(0), tail(0), tombstones(0),
+                                         units(0), nodes(0) {}
+
+    ~ShippingQueue() {
+        for (Entry* chunk : chunks) {
+            delete[] chunk;
+        }
+    }
+
+    ShippingQueue(const ShippingQueue&) = delete;
+
+    // Drop every entry but keep the chunks for reuse
+    void clear() {
+        head = tail = 0;
+        tombstones = 0;
+        chains.clear();
+        units = 0;
+        nodes = 0;
+    }
+
+    ShippingQueue& operator=(const ShippingQueue&) = delete;
+
+    const_iterator begin() const { return const_iterator(this, head); }
+    const_iterator end() const { return const_iterator(this, tail); }
+
+    long long unitCount() const { return units; }
+    size_t entryCount() const { return nodes; }
+
+    bool isEmpty() const {
+        return head == tail;
+    }
+
+    void enqueue(uint32_t itemId,int qty = 1) {
+        units += qty;
+        if (!isEmpty() && at(tail - 1).itemId == itemId) {
+            at(tail - 1).quantity += qty;
+            return;
+        }
+        reserveTail();
+        Entry& e = at(tail);
+        e.itemId = itemId;
+        e.quantity = qty;
+        linkBack(tail);
+        tail++;
+        nodes++;
+    }
+
+    uint32_t dequeue() {
+        if (isEmpty()) {
+            throw runtime_error("No items to ship.!");
+        }
+
+        Entry& e = at(head);
+        uint32_t id = e.itemId;
+        units--;
+        if (e.quantity > 1) {
+            e.quantity--;
+        } else {
+            unlinkHead(id);
+            kill(head);
+        }
+        return id;
+    }
+
+    // Quantity in the front-most entry for this item, or 0 if it is not queued
+    int quantityOf(uint32_t itemId) const {
+        if (itemId >= chains.size() || chains[itemId].head == NO_POS) return 0;
+        return at(chains[itemId].head).quantity;
+    }
+
+    // Take qty units from the front-most entry for this item, dropping it when it empties
+    void take(uint32_t itemId, int qty) {
+        uint64_t pos = chains[itemId].head;
+        at(pos).quantity -= qty;
+        units -= qty;
+        if (at(pos).quantity == 0) {
+            unlinkHead(itemId);
+            kill(pos);
+        }
+    }
+
+    // Quantity of the rear entry, or 0 if the queue is empty
+    int rearQuantity() const {
+        return isEmpty() ? 0 : at(tail - 1).quantity;
+    }
+
+    // Take qty units from the rear entry, dropping it when it empties
+    void takeBack(int qty) {
+        uint64_t pos = tail - 1;
+        at(pos).quantity -= qty;
+        units -= qty;
+        if (at(pos).quantity == 0) {
+            unlinkTail(at(pos).itemId);
+            kill(pos);
+        }
+    }
+
+    // Give the front-most entry for oldId a new item and quantity
+    bool reassign(uint32_t oldId, uint32_t newId, int newQty) {
+        if (quantityOf(oldId) == 0) return false;
+        uint64_t pos = chains[oldId].head;
+        unlinkHead(oldId);
+        units += newQty - at(pos).quantity;
+        at(pos).itemId = newId;
+        at(pos).quantity = newQty;
+        linkOrdered(pos);
+        return true;
+    }
+
+    uint32_t peek() const {
+        if (isEmpty()) {
+            throw runtime_error("No items in shipping queue.");
+        }
+        return at(head).itemId;
+    }
+
+    uint32_t peekBack() const {
+        if (isEmpty()) {
+            throw runtime_error("No items in shipping queue.");
+        }
+        return at(tail - 1).itemId;
+    }
+
+    void displayAll() const {
+        if (isEmpty()) {
+            cout << "Shipping queue is empty." << endl;
+            return;
+        }
+        cout << "Shipping queue items (front to rear): ";
+        for (const Entry& e : *this) {
+            cout << skuDictionary().name(e.itemId) <<  "(" << e.quantity << ") ";
+        }
+        cout << endl;
+    }
+};
+
+#endif
+
+// Read-only view of a whole file, memory-mapped where the platform allows
+class MappedFile {
+private:
+    const char* bytes;
+    size_t length;
+#ifdef _WIN32
+    vector<char> buffer;
+#else
+    int fd;
+    void* mapping;
+#endif
+
+public:
+#ifdef _WIN32
+    MappedFile() : bytes(nullptr), length(0) {}
+#else
+    MappedFile() : bytes(nullptr), length(0), fd(-1), mapping(nullptr) {}
+#endif
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapping != nullptr) munmap(mapping, length);
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const string& filename) {
+#ifdef _WIN32
+        ifstream infile(filename, ios::binary);
+        if (!infile) return false;
+        buffer.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+#else
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) return false;
+        length = static_cast<size_t>(info.st_size);
+        if (length == 0) return true;
+        mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            length = 0;
+            return false;
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(mapping);
+        return true;
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// Make tmp durable and rename it over target, so readers only ever see the
+// old or the new complete file
+inline void commitFile(const string& tmp, const string& target) {
+#ifdef _WIN32
+    remove(target.c_str());
+#else
+    int fd = ::open(tmp.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) ::close(fd);
+    if (!synced) {
+        throw runtime_error("Could not sync " + tmp);
+    }
+#endif
+    if (rename(tmp.c_str(), target.c_str()) != 0) {
+        throw runtime_error("Could not replace " + target);
+    }
+#ifndef _WIN32
+    // The rename itself lives in the directory
+    string dir = filesystem::path(target).parent_path().string();
+    int dirFd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+#endif
+}
+
+// How often the journal reaches the disk. Records are buffered and written
+// in groups of groupOps records or groupBytes bytes, whichever comes first,
+// and every syncEvery group writes are followed by an fsync (0 never syncs).
+struct JournalPolicy {
+    size_t groupOps;
+    size_t groupBytes;
+    size_t syncEvery;
+
+    JournalPolicy(size_t groupOps = 1, size_t groupBytes = 1 << 16, size_t syncEvery = 1)
+        : groupOps(groupOps), groupBytes(groupBytes), syncEvery(syncEvery) {}
+};
+
+// Append-only log of the operations applied since the last snapshot, one
+// text record per line after a "WHJOURNAL <generation>" header:
+//   A qty name        add to inventory
+//   P n [dock]        process n units from the top of the inventory
+//   S n [dock]        ship n units from the front of a dock's queue
+//   p qty name        process qty units of one item
+//   s qty name        ship qty units of one item
+//   R name            remove one unit by name
+//   U qty old<TAB>new update an item
+//   L qty lot received expiry name   receive units into a lot (days)
+//   F qty dock name   move qty units from an item's earliest lots to a dock
+//   X day             drop the lots that expire before day
+//   T class day name  set an item's shipping terms (ShipClass, ship-by day)
+//   B 0|1             switch to the FIFO docks (0) or priority shipping (1)
+//   O n qty name<TAB>qty name...   reserve an order of n merged lines
+// A snapshot stores the generation and byte offset it covers, so startup
+// replays only the records written after it.
+class Journal {
+private:
+    string path;
+    FILE* file;
+    uint64_t gen;
+    uint64_t written;       // bytes already handed to the OS
+    string buffer;
+    size_t pendingOps;
+    size_t unsyncedWrites;
+    JournalPolicy policy;
+    string* tapped;         // also receives every record, see tap
+
+    void writeOut() {
+        if (buffer.empty()) return;
+        if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size() || fflush(file) != 0) {
+            throw runtime_error("Could not write journal " + path);
+        }
+        written += buffer.size();
+        buffer.clear();
+        pendingOps = 0;
+        if (policy.syncEvery != 0 && ++unsyncedWrites >= policy.syncEvery) {
+            sync();
+        }
+    }
+
+public:
+    Journal() : file(nullptr), gen(0), written(0), pendingOps(0), unsyncedWrites(0), tapped(nullptr) {}
+
+    ~Journal() {
+        try {
+            close();
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Open for appending, writing the header if the file is new or empty
+    void open(const string& filename, uint64_t generation, const JournalPolicy& journalPolicy) {
+        close();
+        path = filename;
+        policy = journalPolicy;
+        file = fopen(filename.c_str(), "ab");
+        if (file == nullptr) {
+            throw runtime_error("Could not open journal " + filename);
+        }
+        setvbuf(file, nullptr, _IONBF, 0);  // records are already grouped in buffer
+        fseek(file, 0, SEEK_END);
+        written = static_cast<uint64_t>(ftell(file));
+        gen = generation;
+        if (written == 0) {
+            buffer = "WHJOURNAL " + to_string(gen) + "\n";
+            writeOut();
+            sync();
+        }
+    }
+
+    // Replace the journal with one of a new generation that keeps only the
+    // records from offset keepFrom on (none by default)
+    void restart(uint64_t generation, uint64_t keepFrom = UINT64_MAX) {
+        flush();
+        string tail;
+        if (keepFrom < written) {
+            ifstream old(path, ios::binary);
+            old.seekg(static_cast<streamoff>(keepFrom));
+            tail.assign(istreambuf_iterator<char>(old), istreambuf_iterator<char>());
+        }
+        string filename = path;
+        close();
+        string tmp = filename + ".tmp";
+        remove(tmp.c_str());
+        {
+            Journal fresh;
+            fresh.open(tmp, generation, policy);
+            fresh.buffer = tail;
+            fresh.writeOut();
+        }
+        commitFile(tmp, filename);
+        open(filename, generation, policy);
+    }
+
+    void close() {
+        if (file == nullptr) return;
+        flush();
+        fclose(file);
+        file = nullptr;
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    uint64_t generation() const { return gen; }
+
+    // Offset just past the last record, counting records not yet written
+    uint64_t size() const { return written + buffer.size(); }
+
+    // Append every record queued from now on to sink as well, until tap(nullptr)
+    void tap(string* sink) { tapped = sink; }
+
+    // Queue one record (without its newline); ignored while the journal is closed
+    void record(const string& line) {
+        if (file == nullptr) return;
+        buffer += line;
+        buffer += '\n';
+        if (tapped != nullptr) {
+            *tapped += line;
+            *tapped += '\n';
+        }
+        if (++pendingOps >= policy.groupOps || buffer.size() >= policy.groupBytes) {
+            writeOut();
+        }
+    }
+
+    // Queue several newline-terminated records and write them out as one group
+    void recordBatch(const string& lines) {
+        if (file == nullptr || lines.empty()) return;
+        buffer += lines;
+        if (tapped != nullptr) *tapped += lines;
+        writeOut();
+    }
+
+    void flush() {
+        if (file != nullptr) writeOut();
+    }
+
+    void sync() {
+        if (file == nullptr) return;
+#ifdef _WIN32
+        _commit(_fileno(file));
+#else
+        fsync(fileno(file));
+#endif
+        unsyncedWrites = 0;
+    }
+};
+
+// Binary snapshot layout, all fields in host byte order:
+//   SnapshotHeader
+//   uint64_t dockQueueCounts[dockCount]   entries queued at each dock
+//   uint64_t nameOffsets[nameCount + 1]   into the name bytes
+//   char     names[nameBytes]             padded to a multiple of 8
+//   SnapshotRecord stack[stackCount]      top to bottom
+//   SnapshotRecord queue[queueCount]      front to rear, dock by dock
+//   SnapshotLot    lots[lotCount]         earliest expiry first
+//   SnapshotShipment priority[priorityCount]  in shipping order
+//   SnapshotTerms  terms[termsCount]      items with other than standard terms
+// Record name ids index the snapshot's own name table, not the live dictionary.
+// Version 2 added the journal position the snapshot covers; version 1 files
+// have a 40-byte header and are read as covering no journal. Version 3
+// added the docks; older files hold a single queue. Version 4 added
+// priority shipping. Version 5 added lots.
+const char SNAPSHOT_MAGIC[8] = {'W', 'H', 'S', 'N', 'A', 'P', '\r', '\n'};
+
+const uint32_t SNAPSHOT_VERSION = 5;
+
+const size_t SNAPSHOT_HEADER_SIZES[SNAPSHOT_VERSION + 1] = {0, 40, 56, 64, 88, 96};  // by version
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nameCount;
+    uint64_t nameBytes;
+    uint64_t stackCount;
+    uint64_t queueCount;
+    uint64_t journalGeneration;
+    uint64_t journalOffset;
+    uint64_t dockCount;
+    uint64_t priorityCount;
+    uint64_t termsCount;
+    uint32_t priorityShipping;  // 1 while the priority queue is the shipping queue
+    uint32_t reserved;
+    uint64_t lotCount;
+};
+
+struct SnapshotRecord {
+    uint32_t nameId;
+    int32_t quantity;
+};
+
+struct SnapshotLot {
+    uint64_t lotId;
+    uint32_t nameId;
+    int32_t quantity;
+    int32_t received;
+    int32_t expiry;
+};
+
+struct SnapshotShipment {
+    uint32_t nameId;
+    int32_t quantity;
+    uint32_t shipClass;
+    uint32_t deadline;
+};
+
+struct SnapshotTerms {
+    uint32_t nameId;
+    uint32_t shipClass;
+    uint32_t deadline;
+};
+
+static_assert(sizeof(SnapshotHeader) == 96, "snapshot header must not be padded");
+
+static_assert(sizeof(SnapshotRecord) == 8, "snapshot record must not be padded");
+
+static_assert(sizeof(SnapshotLot) == 24, "snapshot lot must not be padded");
+
+static_assert(sizeof(SnapshotShipment) == 16, "snapshot shipment must not be padded");
+
+static_assert(sizeof(SnapshotTerms) == 12, "snapshot terms must not be padded");
+
+// Text saves start with this line and hold one "quantity<TAB>name" run per
+// line, the stack top to bottom and the queue front to rear. Each dock
+// after the first follows as a "--- Shipping Dock N ---" section, and
+// lots, if any, as a "--- Lots ---" section (see formatLotLine). Files
+// without the header are the older one-unit-per-line format.
+const string TEXT_SAVE_HEADER = "--- Warehouse Save v2 ---";
+
+// Bulk imports read the file in chunks of this size; each chunk is split
+// into line-aligned blocks that are parsed on worker threads
+const size_t IMPORT_CHUNK_BYTES = 8 << 20;
+
+// Item names hold ASCII letters and whitespace (" \t\n\v\f\r") and at
+// least one letter. The canonical form is lower case with single spaces
+// between words and none at the ends; it is what gets stored.
+enum NameStatus { NAME_OK, NAME_EMPTY, NAME_BAD_CHAR };
+
+// Running state of one normalizeName pass
+struct NameScan {
+    bool hasLetter = false;
+    bool needsCompaction = false;  // leading, trailing or repeated spaces
+    bool prevSpace = true;         // so a leading space counts as repeated
+};
+
+// Fold one byte: letters to lower case, whitespace to ' '
+inline bool foldNameChar(char& c, NameScan& scan) {
+    unsigned char u = static_cast<unsigned char>(c);
+    unsigned char lower = u | 0x20;
+    if (lower >= 'a' && lower <= 'z') {
+        c = static_cast<char>(lower);
+        scan.hasLetter = true;
+        scan.prevSpace = false;
+        return true;
+    }
+    if (u == ' ' || (u >= '\t' && u <= '\r')) {
+        c = ' ';
+        if (scan.prevSpace) scan.needsCompaction = true;
+        scan.prevSpace = true;
+        return true;
+    }
+    return false;
+}
+
+// Bookkeeping shared by the vector kernels, from per-byte bit masks
+inline void scanNameMasks(uint32_t letters, uint32_t spaces, unsigned width, NameScan& scan) {
+    if (letters != 0) scan.hasLetter = true;
+    if (spaces & ((spaces << 1) | (scan.prevSpace ? 1u : 0u))) scan.needsCompaction = true;
+    scan.prevSpace = (spaces >> (width - 1)) & 1;
+}
+
+// The vector kernels classify a block with two range checks each: adding
+// an offset moves the wanted range to the bottom of the signed byte range,
+// so one signed compare covers it.
+#ifdef WAREHOUSE_NAME_SSE2
+inline bool foldNameBlockSse2(char* p, NameScan& scan) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_cmplt_epi8(_mm_add_epi8(lower, _mm_set1_epi8(static_cast<char>(128 - 'a'))),
+                                    _mm_set1_epi8(static_cast<char>(-128 + 26)));
+    __m128i space = _mm_or_si128(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+        _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(128 - '\t'))),
+                       _mm_set1_epi8(static_cast<char>(-128 + 5))));
+    uint32_t letters = static_cast<uint32_t>(_mm_movemask_epi8(letter));
+    uint32_t spaces = static_cast<uint32_t>(_mm_movemask_epi8(space));
+    if ((letters | spaces) != 0xFFFFu) return false;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                     _mm_or_si128(_mm_and_si128(letter, lower), _mm_and_si128(space, _mm_set1_epi8(' '))));
+    scanNameMasks(letters, spaces, 16, scan);
+    return true;
+}
+#endif
+
+#ifdef WAREHOUSE_NAME_AVX2
+__attribute__((target("avx2")))
+inline bool foldNameBlockAvx2(char* p, NameScan& scan) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)),
+                                       _mm256_add_epi8(lower, _mm256_set1_epi8(static_cast<char>(128 - 'a'))));
+    __m256i space = _mm256_or_si256(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 5)),
+                          _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(128 - '\t')))));
+    uint32_t letters = static_cast<uint32_t>(_mm256_movemask_epi8(letter));
+    uint32_t spaces = static_cast<uint32_t>(_mm256_movemask_epi8(space));
+    if ((letters | spaces) != 0xFFFFFFFFu) return false;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),
+                        _mm256_or_si256(_mm256_and_si256(letter, lower),
+                                        _mm256_and_si256(space, _mm256_set1_epi8(' '))));
+    scanNameMasks(letters, spaces, 32, scan);
+    return true;
+}
+
+inline bool cpuHasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+// Validate name[0, length) and rewrite it in place in canonical form,
+// updating length. The bytes are unspecified when the name is rejected.
+inline NameStatus normalizeName(char* name, size_t& length) {
+    NameScan scan;
+    size_t i = 0;
+#ifdef WAREHOUSE_NAME_AVX2
+    if (cpuHasAvx2()) {
+        for (; i + 32 <= length; i += 32) {
+            if (!foldNameBlockAvx2(name + i, scan)) return NAME_BAD_CHAR;
+        }
+    }
+#endif
+#ifdef WAREHOUSE_NAME_SSE2
+    for (; i + 16 <= length; i += 16) {
+        if (!foldNameBlockSse2(name + i, scan)) return NAME_BAD_CHAR;
+    }
+#endif
+    for (; i < length; i++) {
+        if (!foldNameChar(name[i], scan)) return NAME_BAD_CHAR;
+    }
+    if (!scan.hasLetter) return NAME_EMPTY;
+
+    if (scan.needsCompaction || scan.prevSpace) {
+        size_t out = 0;
+        for (i = 0; i < length; i++) {
+            if (name[i] != ' ') {
+                name[out++] = name[i];
+            } else if (out > 0 && name[out - 1] != ' ') {
+                name[out++] = ' ';
+            }
+        }
+        if (name[out - 1] == ' ') out--;
+        length = out;
+    }
+    return NAME_OK;
+}
+
+inline NameStatus normalizeName(string& name) {
+    size_t length = name.size();
+    NameStatus status = normalizeName(name.data(), length);
+    if (status == NAME_OK) name.resize(length);
+    return status;
+}
+
+// Canonical form of a name read from a file; names the rules reject are
+// kept as written so older saves still load
+inline string canonicalItemName(const string& name) {
+    string canonical = name;
+    return normalizeName(canonical) == NAME_OK ? canonical : name;
+}
+
+// Interns names read from one file in canonical form and remembers the
+// spellings it had to rewrite, so a load that folds "Widget" and "widget"
+// from a save written before names were case-folded can say so
+class NameFolds {
+private:
+    vector<char> keptAsWritten;               // by item id
+    vector<pair<uint32_t, string>> rewritten;  // item id, spelling in the file
+
+public:
+    uint32_t intern(const string& name) {
+        string canonical = canonicalItemName(name);
+        uint32_t id = skuDictionary().intern(canonical);
+        if (canonical == name) {
+            if (id >= keptAsWritten.size()) keptAsWritten.resize(id + 1, 0);
+            keptAsWritten[id] = 1;
+        } else if (rewritten.empty() || rewritten.back() != make_pair(id, name)) {
+            rewritten.push_back({id, name});
+        }
+        return id;
+    }
+
+    // One line per item that two or more spellings in the file folded into
+    void report(const string& filename) {
+        sort(rewritten.begin(), rewritten.end());
+        rewritten.erase(unique(rewritten.begin(), rewritten.end()), rewritten.end());
+        for (size_t i = 0; i < rewritten.size();) {
+            uint32_t id = rewritten[i].first;
+            size_t end = i;
+            while (end < rewritten.size() && rewritten[end].first == id) end++;
+            bool kept = id < keptAsWritten.size() && keptAsWritten[id];
+            if (end - i + kept >= 2) {
+                cout << "Note:";
+                for (size_t j = i; j < end; j++) {
+                    cout << (j == i ? " \"" : ", \"") << rewritten[j].second << "\"";
+                }
+                if (kept) cout << ", \"" << skuDictionary().name(id) << "\"";
+                cout << " in " << filename << " are now one item, \"" << skuDictionary().name(id) << "\"" << endl;
+            }
+            i = end;
+        }
+        rewritten.clear();
+        keptAsWritten.clear();
+    }
+};
+
+// Quantity field of a receipt row: a positive int, spaces allowed around it
+inline bool parseQuantity(const char* begin, const char* end, int& qty) {
+    while (begin < end && *begin == ' ') begin++;
+    while (end > begin && end[-1] == ' ') end--;
+    if (begin == end) return false;
+    long long value = 0;
+    for (const char* c = begin; c < end; c++) {
+        if (*c < '0' || *c > '9') return false;
+        value = value * 10 + (*c - '0');
+        if (value > numeric_limits<int>::max()) return false;
+    }
+    qty = static_cast<int>(value);
+    return qty > 0;
+}
+
+// A validated receipt row; name points into the chunk being imported,
+// where it has been rewritten in canonical form
+struct ReceiptRow {
+    const char* name;
+    size_t length;
+    int qty;
+};
+
+struct ReceiptBlock {
+    vector<ReceiptRow> rows;
+    size_t lines = 0;
+    size_t rejected = 0;
+    size_t firstRejected = 0;  // 1-based line within the block, 0 if none
+    string records;            // journal records for the rows, if asked for
+};
+
+// Parse "name,qty" or "name<TAB>qty" lines; blank lines are skipped
+inline ReceiptBlock parseReceiptBlock(char* begin, char* end, bool journaled) {
+    ReceiptBlock block;
+    block.rows.reserve(static_cast<size_t>(end - begin) / 16);
+    while (begin < end) {
+        char* eol = static_cast<char*>(memchr(begin, '\n', end - begin));
+        if (eol == nullptr) eol = end;
+        char* last = eol;
+        if (last > begin && last[-1] == '\r') last--;
+        block.lines++;
+
+        if (last > begin) {
+            char* sep = last;
+            while (sep > begin && sep[-1] != ',' && sep[-1] != '\t') sep--;
+            int qty = 0;
+            size_t length = sep > begin ? static_cast<size_t>(sep - 1 - begin) : 0;
+            if (sep > begin && parseQuantity(sep, last, qty) && normalizeName(begin, length) == NAME_OK) {
+                block.rows.push_back({begin, length, qty});
+                if (journaled) {
+                    block.records += "A ";
+                    block.records += to_string(qty);
+                    block.records += ' ';
+                    block.records.append(begin, length);
+                    block.records += '\n';
+                }
+            } else {
+                if (block.rejected++ == 0) block.firstRejected = block.lines;
+            }
+        }
+        begin = eol + 1;
+    }
+    return block;
+}
+
+// Outcome of importReceipts
+struct ImportStats {
+    size_t rows = 0;            // rows added to the inventory
+    size_t rejected = 0;
+    size_t firstRejected = 0;   // 1-based line number, 0 if none
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+// Writes checkpoints on a thread of its own from a replica of the warehouse.
+// The replica is restored once from a snapshot image and then brought up to
+// date by replaying the journal records handed over with each checkpoint,
+// so the owner only pays for swapping those records out, whatever the
+// warehouse size. The price is a second copy of the warehouse in memory.
+// The thread interns names into its own SkuDictionary.
+template <typename Warehouse>
+class CheckpointWriter {
+private:
+    enum State { IDLE, RUNNING, WRITTEN, FAILED };
+
+    thread worker;
+    mutex lock;
+    condition_variable changed;
+    State state = IDLE;
+    bool stopping = false;
+    string image;          // consumed by the thread on startup
+    string records;        // journal records for the running checkpoint
+    uint64_t generation = 0;
+    uint64_t offset = 0;
+    string textFile;
+    string snapshotFile;
+
+    void run() {
+#ifdef __linux__
+        // Batch threads do not preempt on wakeup, so handing over a
+        // checkpoint does not cost the owner the writer's time slice when
+        // they share a core
+        sched_param param = sched_param();
+        pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+#endif
+        SkuDictionary dictionary;
+        threadDictionary() = &dictionary;
+        Warehouse replica;  // destroyed before the dictionary it interned into
+        bool restored = true;
+        try {
+            replica.restoreImage(image);
+        } catch (const runtime_error&) {
+            restored = false;
+        }
+        string().swap(image);
+
+        unique_lock<mutex> held(lock);
+        while (true) {
+            changed.wait(held, [this] { return stopping || state == RUNNING; });
+            if (stopping) break;
+            string replay;
+            replay.swap(records);
+            held.unlock();
+            bool written = restored;
+            if (restored) {
+                try {
+                    replica.writeCheckpoint(replay, generation, offset, textFile, snapshotFile);
+                } catch (const runtime_error&) {
+                    written = false;
+                }
+            }
+            replay = string();  // freed here rather than by the owner
+            held.lock();
+            state = written ? WRITTEN : FAILED;
+            changed.notify_all();
+        }
+    }
+
+public:
+    CheckpointWriter() = default;
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    ~CheckpointWriter() {
+        if (!worker.joinable()) return;
+        {
+            lock_guard<mutex> held(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    // Start the thread with a replica restored from a snapshot image of the
+    // owner, to write these files from; call once
+    void start(string snapshotImage, const string& text, const string& snapshot) {
+        image = move(snapshotImage);
+        textFile = text;
+        snapshotFile = snapshot;
+        worker = thread(&CheckpointWriter::run, this);
+    }
+
+    bool started() const { return worker.joinable(); }
+
+    // Begin a checkpoint at this journal position, taking over the records
+    // journaled since the previous one; pending is left empty
+    void begin(string& pending, uint64_t journalGeneration, uint64_t journalOffset) {
+        {
+            lock_guard<mutex> held(lock);
+            records.swap(pending);
+            generation = journalGeneration;
+            offset = journalOffset;
+            state = RUNNING;
+        }
+        changed.notify_all();
+    }
+
+    bool running() {
+        lock_guard<mutex> held(lock);
+        return state == RUNNING;
+    }
+
+    // False while no checkpoint has ended since the last call, after waiting
+    // for a running one if wait is set; otherwise true, with written telling
+    // whether both files were written
+    bool collect(bool wait, bool& written) {
+        unique_lock<mutex> held(lock);
+        if (wait) changed.wait(held, [this] { return state != RUNNING; });
+        if (state != WRITTEN && state != FAILED) return false;
+        written = state == WRITTEN;
+        state = IDLE;
+        return true;
+    }
+};
+
+// Canonical form of a name typed at a prompt, see normalizeName
+inline string checkedItemName(string name) {
+    switch (normalizeName(name)) {
+        case NAME_EMPTY:
+            throw invalid_argument("Invalid item name! Cannot be empty or only spaces.");
+        case NAME_BAD_CHAR:
+            throw invalid_argument("Invalid item name! Only letters are allowed.");
+        default:
+            return name;
+    }
+}
+
+// How often the interactive loop writes a background checkpoint
+const chrono::seconds CHECKPOINT_INTERVAL(30);
+
+// Final save on the way out
+template <typename Warehouse>
+void saveWarehouse(Warehouse& warehouse) {
+    warehouse.finishCheckpoint();
+    warehouse.saveToFile("result.txt");
+    warehouse.saveSnapshot("result.snap");
+    warehouse.resetJournal();
+}
+
+// Batch mode groups journal records and syncs once per group
+const JournalPolicy BATCH_JOURNAL_POLICY(1024, 1 << 20, 1);
+
+// Input for batch mode: read in large blocks and handed out a line at a time
+class BatchReader {
+private:
+    FILE* in;
+    vector<char> buffer;
+    size_t begin;
+    size_t end;
+    bool atEof;
+
+public:
+    explicit BatchReader(FILE* in) : in(in), buffer(1 << 16), begin(0), end(0), atEof(false) {}
+
+    // Next line without its line ending; false at the end of the input
+    bool next(string_view& line) {
+        while (true) {
+            const char* data = buffer.data();
+            const char* eol = static_cast<const char*>(memchr(data + begin, '\n', end - begin));
+            if (eol != nullptr || (atEof && begin < end)) {
+                size_t stop = eol != nullptr ? static_cast<size_t>(eol - data) : end;
+                line = string_view(data + begin, stop - begin);
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                begin = eol != nullptr ? stop + 1 : end;
+                return true;
+            }
+            if (atEof) return false;
+            // Keep the partial line and fill the rest of the buffer
+            memmove(buffer.data(), data + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            if (end == buffer.size()) buffer.resize(buffer.size() * 2);
+            size_t got = fread(buffer.data() + end, 1, buffer.size() - end, in);
+            end += got;
+            if (got == 0) atEof = true;
+        }
+    }
+};
+
+// cout's buffer in batch mode. endl no longer forces a write; output goes
+// out when the buffer fills and at the explicit flush points (drain).
+class BatchOutput : public streambuf {
+private:
+    FILE* out;
+    vector<char> buffer;
+
+protected:
+    int_type overflow(int_type c) override {
+        drain();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override { return 0; }
+
+public:
+    explicit BatchOutput(FILE* out) : out(out), buffer(1 << 16) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    void drain() {
+        fwrite(pbase(), 1, pptr() - pbase(), out);
+        fflush(out);
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+};
+
+// Split off the first space-separated word of args
+inline string_view nextWord(string_view& args) {
+    size_t space = args.find(' ');
+    string_view word = args.substr(0, space);
+    args = space == string_view::npos ? string_view() : args.substr(space + 1);
+    while (!args.empty() && args.front() == ' ') args.remove_prefix(1);
+    return word;
+}
+
+// A positive count; rejects anything else, including overflow
+inline bool parseCount(string_view word, long long& value) {
+    if (word.empty() || word.size() > 18) return false;
+    value = 0;
+    for (char c : word) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    return value > 0;
+}
+
+#ifdef __linux__
+// Server mode protocol. Every frame starts with a 32-bit length (host byte
+// order) of the rest of the frame.
+//   request:  u8 op, i64 number, name bytes up to the end of the frame
+//   response: u8 status (0 done, 1 rejected), the text the command printed
+// Requests on one connection are answered in order, so clients may
+// pipeline as many as they like.
+enum ServerOp : uint8_t { OP_ADD = 1, OP_PROCESS, OP_SHIP, OP_SEARCH, OP_COUNT, OP_SNAPSHOT };
+
+const size_t REQUEST_HEADER = 1 + sizeof(int64_t);
+
+const uint32_t MAX_FRAME = 1 << 20;
+
+// Server mode defers journal writes to one group per event loop pass
+const JournalPolicy SERVER_JOURNAL_POLICY(numeric_limits<size_t>::max(), 1 << 20, 1);
+
+inline void appendRequest(string& out, ServerOp op, int64_t number, const string& name) {
+    uint32_t length = static_cast<uint32_t>(REQUEST_HEADER + name.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += static_cast<char>(op);
+    out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    out += name;
+}
+
+// "path" is a Unix domain socket, a bare number a localhost TCP port
+inline bool isTcpAddress(const string& address) {
+    return !address.empty() && all_of(address.begin(), address.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// The port of a TCP address; false unless it is 1 to 65535
+inline bool parsePort(const string& address, uint16_t& port) {
+    long long value = 0;
+    if (!parseCount(address, value) || value > numeric_limits<uint16_t>::max()) return false;
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+// The address argument argv[index] of --serve and --loadgen; false if it
+// is absent or a port out of range
+inline bool addressArgument(int argc, char* argv[], int index) {
+    if (index >= argc) return false;
+    uint16_t port = 0;
+    if (isTcpAddress(argv[index]) && !parsePort(argv[index], port)) {
+        cerr << argv[index] << " is not a TCP port (1 to 65535)" << endl;
+        return false;
+    }
+    return true;
+}
+
+inline int openSocket(const string& address, bool listening) {
+    int fd;
+    int rc;
+    if (isTcpAddress(address)) {
+        uint16_t port = 0;
+        if (!parsePort(address, port)) throw runtime_error("Not a TCP port (1 to 65535): " + address);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) throw runtime_error("Could not create a socket.");
+        sockaddr_in addr = sockaddr_in();
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            rc = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        } else {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            rc = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        }
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw runtime_error("Could not create a socket.");
+        sockaddr_un addr = sockaddr_un();
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) {
+            ::close(fd);
+            throw runtime_error("Socket path too long: " + address);
+        }
+        memcpy(addr.sun_path, address.c_str(), address.size() + 1);
+        if (listening) {
+            unlink(address.c_str());
+            rc = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        } else {
+            rc = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        }
+    }
+    if (rc == 0 && listening) rc = listen(fd, SOMAXCONN);
+    if (rc != 0) {
+        ::close(fd);
+        throw runtime_error(string(listening ? "Could not listen on " : "Could not connect to ") + address
+                            + ": " + strerror(errno));
+    }
+    return fd;
+}
+
+// cout's target while a request runs: the connection's output buffer
+class ResponseBuffer : public streambuf {
+private:
+    string* out = nullptr;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) out->push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+        out->append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+public:
+    void target(string* buffer) { out = buffer; }
+};
+
+struct ServerConnection {
+    int fd;
+    string in;            // request bytes not yet executed
+    string out;           // responses not yet written
+    size_t written = 0;   // prefix of out already sent
+    bool watchingWrites = false;
+};
+
+inline volatile sig_atomic_t serverStopping = 0;
+
+extern "C" inline void stopServer(int) {
+    serverStopping = 1;
+}
+
+// Execute every complete frame in conn.in, appending the responses to
+// conn.out; false if the client broke the framing
+template <typename Warehouse>
+bool serveFrames(Warehouse& warehouse, ServerConnection& conn, ResponseBuffer& responses) {
+    size_t pos = 0;
+    while (conn.in.size() - pos >= sizeof(uint32_t)) {
+        uint32_t length;
+        memcpy(&length, conn.in.data() + pos, sizeof(length));
+        if (length < REQUEST_HEADER || length > MAX_FRAME) return false;
+        if (conn.in.size() - pos - sizeof(length) < length) break;
+
+        const char* frame = conn.in.data() + pos + sizeof(length);
+        ServerOp op = static_cast<ServerOp>(frame[0]);
+        int64_t number;
+        memcpy(&number, frame + 1, sizeof(number));
+        string name(frame + REQUEST_HEADER, length - REQUEST_HEADER);
+        pos += sizeof(length) + length;
+
+        size_t start = conn.out.size();
+        conn.out.append(sizeof(uint32_t) + 1, '\0');
+        responses.target(&conn.out);
+        streambuf* saved = cout.rdbuf(&responses);
+        bool done;
+        try {
+            done = executeRequest(warehouse, op, number, name);
+        } catch (const exception& e) {
+            cout << e.what() << endl;
+            done = false;
+        }
+        cout.rdbuf(saved);
+        uint32_t responseLength = static_cast<uint32_t>(conn.out.size() - start - sizeof(uint32_t));
+        memcpy(&conn.out[start], &responseLength, sizeof(responseLength));
+        conn.out[start + sizeof(uint32_t)] = done ? 0 : 1;
+    }
+    conn.in.erase(0, pos);
+    return true;
+}
+
+// Serve requests on address until SIGINT or SIGTERM. One thread runs an
+// epoll loop: each pass reads everything that arrived, executes all the
+// complete requests, writes the journal once for all of them and only
+// then sends the responses, one write per connection.
+// Warehouse is the program's WarehouseSystem; the program also supplies
+// executeRequest and loadWarehouse for it.
+template <typename Warehouse>
+int runServer(const string& address) {
+    Warehouse warehouse;
+    loadWarehouse(warehouse, SERVER_JOURNAL_POLICY);
+
+    int listener;
+    try {
+        listener = openSocket(address, true);
+    } catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    int epfd = epoll_create1(0);
+    epoll_event ev = epoll_event();
+    ev.events = EPOLLIN;
+    ev.data.fd = listener;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+
+    struct sigaction action = {};
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    cerr << "Serving on " << address << endl;
+
+    vector<unique_ptr<ServerConnection>> connections;  // indexed by fd
+    vector<int> pending;                               // fds with new output
+    vector<epoll_event> events(256);
+    vector<char> chunk(1 << 16);
+    ResponseBuffer responses;
+
+    auto drop = [&](int fd) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections[fd].reset();
+    };
+
+    while (!serverStopping) {
+        warehouse.checkpointIfDue();
+        int ready = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+                int client;
+                while ((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+                    if (static_cast<size_t>(client) >= connections.size()) connections.resize(client + 1);
+                    connections[client].reset(new ServerConnection());
+                    connections[client]->fd = client;
+                    epoll_event clientEv = epoll_event();
+                    clientEv.events = EPOLLIN;
+                    clientEv.data.fd = client;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, client, &clientEv);
+                }
+                continue;
+            }
+
+            ServerConnection& conn = *connections[fd];
+            if (events[i].events & EPOLLOUT) pending.push_back(fd);
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) continue;
+            bool open = true;
+            while (true) {
+                ssize_t got = recv(fd, chunk.data(), chunk.size(), 0);
+                if (got > 0) {
+                    conn.in.append(chunk.data(), static_cast<size_t>(got));
+                    continue;
+                }
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (got < 0 && errno == EINTR) continue;
+                open = false;  // closed by the client or failed
+                break;
+            }
+            if (!serveFrames(warehouse, conn, responses)) open = false;
+            if (!open && conn.out.size() == conn.written) {
+                drop(fd);
+                continue;
+            }
+            pending.push_back(fd);
+        }
+
+        // Group commit: one journal write covers every request of this pass
+        warehouse.flushJournal();
+
+        for (int fd : pending) {
+            if (static_cast<size_t>(fd) >= connections.size() || !connections[fd]) continue;
+            ServerConnection& conn = *connections[fd];
+            while (conn.written < conn.out.size()) {
+                ssize_t sent = send(fd, conn.out.data() + conn.written, conn.out.size() - conn.written, MSG_NOSIGNAL);
+                if (sent <= 0) break;
+                conn.written += static_cast<size_t>(sent);
+            }
+            if (conn.written == conn.out.size()) {
+                conn.out.clear();
+                conn.written = 0;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                drop(fd);
+                continue;
+            }
+            bool watch = !conn.out.empty();
+            if (watch != conn.watchingWrites) {
+                epoll_event clientEv = epoll_event();
+                clientEv.events = watch ? EPOLLIN | EPOLLOUT : EPOLLIN;
+                clientEv.data.fd = fd;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &clientEv);
+                conn.watchingWrites = watch;
+            }
+        }
+        pending.clear();
+    }
+
+    for (auto& conn : connections) {
+        if (conn) ::close(conn->fd);
+    }
+    ::close(listener);
+    ::close(epfd);
+    if (!isTcpAddress(address)) unlink(address.c_str());
+    cerr << "Server stopping" << endl;
+    saveWarehouse(warehouse);
+    return 0;
+}
+
+// One load generator connection: keeps up to `pipeline` requests in
+// flight and records each request's round trip in nanoseconds
+inline void loadgenConnection(const string& address, size_t requests, size_t pipeline, unsigned seed,
+                       vector<uint64_t>& latencies, string& error) {
+    try {
+        int fd = openSocket(address, false);
+        mt19937 rng(seed);
+        deque<chrono::steady_clock::time_point> inFlight;
+        string out;
+        string in;
+        vector<char> chunk(1 << 16);
+        size_t sent = 0;
+        latencies.reserve(requests);
+
+        while (latencies.size() < requests) {
+            out.clear();
+            auto now = chrono::steady_clock::now();
+            while (sent < requests && inFlight.size() < pipeline) {
+                string name = "item " + string(1, static_cast<char>('a' + rng() % 26));
+                switch (rng() % 10) {
+                    case 0: case 1: case 2: case 3:
+                        appendRequest(out, OP_ADD, 1 + rng() % 9, name);
+                        break;
+                    case 4: case 5:
+                        appendRequest(out, OP_PROCESS, 1 + rng() % 5, name);
+                        break;
+                    case 6: case 7:
+                        appendRequest(out, OP_SHIP, 1 + rng() % 5, name);
+                        break;
+                    case 8:
+                        appendRequest(out, OP_SEARCH, 0, name);
+                        break;
+                    default:
+                        appendRequest(out, OP_COUNT, 0, "");
+                }
+                inFlight.push_back(now);
+                sent++;
+            }
+            for (size_t done = 0; done < out.size();) {
+                ssize_t n = send(fd, out.data() + done, out.size() - done, MSG_NOSIGNAL);
+                if (n <= 0) throw runtime_error("Connection lost while sending.");
+                done += static_cast<size_t>(n);
+            }
+
+            ssize_t got = recv(fd, chunk.data(), chunk.size(), 0);
+            if (got <= 0) throw runtime_error("Connection closed by the server.");
+            in.append(chunk.data(), static_cast<size_t>(got));
+            auto arrived = chrono::steady_clock::now();
+            size_t pos = 0;
+            uint32_t length;
+            while (in.size() - pos >= sizeof(length)) {
+                memcpy(&length, in.data() + pos, sizeof(length));
+                if (in.size() - pos - sizeof(length) < length) break;
+                pos += sizeof(length) + length;
+                latencies.push_back(static_cast<uint64_t>(
+                    chrono::duration_cast<chrono::nanoseconds>(arrived - inFlight.front()).count()));
+                inFlight.pop_front();
+            }
+            in.erase(0, pos);
+        }
+        ::close(fd);
+    } catch (const exception& e) {
+        error = e.what();
+    }
+}
+
+// Drive a server with a request mix on several connections and report
+// throughput and latency percentiles
+inline int runLoadgen(const string& address, size_t connectionCount, size_t requests, size_t pipeline) {
+    connectionCount = max<size_t>(connectionCount, 1);
+    pipeline = max<size_t>(pipeline, 1);
+    vector<vector<uint64_t>> latencies(connectionCount);
+    vector<string> errors(connectionCount);
+    vector<thread> workers;
+    auto started = chrono::steady_clock::now();
+    for (size_t i = 0; i < connectionCount; i++) {
+        size_t share = requests / connectionCount + (i < requests % connectionCount ? 1 : 0);
+        workers.emplace_back(loadgenConnection, cref(address), share, pipeline, static_cast<unsigned>(i + 1),
+                             ref(latencies[i]), ref(errors[i]));
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    vector<uint64_t> all;
+    for (size_t i = 0; i < connectionCount; i++) {
+        if (!errors[i].empty()) cerr << "connection " << i << ": " << errors[i] << endl;
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    }
+    if (all.empty()) return 1;
+    sort(all.begin(), all.end());
+    auto percentile = [&](double q) {
+        return all[min(all.size() - 1, static_cast<size_t>(q * all.size()))] / 1000.0;
+    };
+    cout << all.size() << " request(s) on " << connectionCount << " connection(s), pipeline " << pipeline
+         << ", in " << seconds << " s: " << static_cast<long long>(all.size() / seconds) << " req/s" << endl;
+    cout << "latency us: p50 " << percentile(0.50) << ", p99 " << percentile(0.99)
+         << ", p999 " << percentile(0.999) << ", max " << all.back() / 1000.0 << endl;
+    return 0;
+}
+#endif
+
+// Read the optional count argument argv[index] into value, which keeps its
+// default when the argument is absent; false if it is not a positive number
+inline bool countArgument(int argc, char* argv[], int index, size_t& value) {
+    if (index >= argc) return true;
+    long long count = 0;
+    if (!parseCount(argv[index], count)) {
+        cerr << argv[index] << " is not a positive count" << endl;
+        return false;
+    }
+    value = static_cast<size_t>(count);
+    return true;
+}
+
+inline int usage(const string& mode) {
+    cerr << "usage: warehouse " << mode << endl;
+    return 1;
+}
+
+#endif  // WAREHOUSE_COMMON_H
@@ -1,437 +1,3250 @@
-#include <iostream>
-#include <string>
-#include <limits>
-#include <stdexcept>
-#include <fstream>
-using namespace std;
-
-// Node for Stack and Queue
-struct ItemNode {
-    string itemName;
-    ItemNode* next;
-    int quantity;
-
-    ItemNode(string name,int qty = 1) : itemName(name),quantity(qty), next(nullptr) {}
+#include "warehouse_common.h"
+#include <atomic>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <new>
+#include <tuple>
+
+// Allocator for 64-byte aligned blocks, so that a heap's groups of
+// siblings each sit on a single cache line
+template <typename T>
+struct CacheLineAllocator {
+    using value_type = T;
+
+    CacheLineAllocator() = default;
+    template <typename U>
+    CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(64)));
+    }
+
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, align_val_t(64));
+    }
+
+    template <typename U>
+    bool operator==(const CacheLineAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CacheLineAllocator<U>&) const { return false; }
 };
 
-// Stack class for incoming items (LIFO)
-class InventoryStack {
-private:
-    ItemNode* top;
+enum ShipClass : uint8_t { SHIP_EXPRESS, SHIP_STANDARD, SHIP_ECONOMY };
 
+// Shipping queue ordered by class, then deadline, then arrival: express
+// before standard before economy, earlier deadlines first within a class,
+// and entries with equal class and deadline in FIFO order (so a class
+// without deadlines is a plain FIFO). Entries carry quantities like
+// ShippingQueue's, but repeated enqueues are not merged.
+// Backed by a 4-ary min-heap on a single 64-bit key. The array starts 3
+// slots in, which puts every group of 4 siblings (16 bytes each) on its
+// own cache line, so a sift-down step touches one line. peek is O(1);
+// dequeue is O(1) while the top entry has units left and O(log n) when
+// it empties; enqueue is O(log n).
+// Quantities live in a table beside the heap, and each item keeps its own
+// small heap of (key, quantity slot), so the first entry to ship for an
+// item is read and taken from without searching the main heap. An entry
+// emptied that way stays in the main heap with quantity 0 and is dropped
+// when it reaches the top, so the top is always a live entry.
+class PriorityShippingQueue {
 public:
+    static constexpr uint32_t NO_DEADLINE = (uint32_t(1) << 30) - 1;
 
-    ItemNode* getTop() const { return top; }
+private:
+    static constexpr size_t ROOT = 3;  // physical slot of the root
 
-    void setTop(ItemNode* node) { top = node; }
+    struct HeapEntry {
+        uint64_t key;       // class:2 | deadline:30 | arrival:32
+        uint32_t itemId;
+        uint32_t slot;      // index into quantities
+    };
 
-    InventoryStack() : top(nullptr) {}
+    using ItemEntry = pair<uint64_t, uint32_t>;  // key, quantity slot
 
-    ~InventoryStack() {
-        while (!isEmpty()) {
-            pop();
-        }
-    }
+    vector<HeapEntry, CacheLineAllocator<HeapEntry>> heap;
+    vector<int32_t> quantities;        // 0 once an entry is emptied
+    vector<uint32_t> freeSlots;
+    vector<vector<ItemEntry>> byItem;  // per item, a min-heap by key
+    size_t live;                       // entries not yet emptied
+    uint64_t nextArrival;
+    long long units;
 
-    bool isEmpty() const {
-        return top == nullptr;
-    }
+    HeapEntry& at(size_t i) { return heap[i + ROOT]; }
+    const HeapEntry& at(size_t i) const { return heap[i + ROOT]; }
+    size_t count() const { return heap.size() - ROOT; }
 
-    void push(string itemName, int qty = 1)
-    {
-        if (!isEmpty() && top->itemName == itemName)
-        {
-            top->quantity += qty;
-            return;
+    // The item's first entry to ship; only valid while it has one
+    const ItemEntry& frontOf(uint32_t itemId) const { return byItem[itemId].front(); }
 
-        }
-        ItemNode* newNode = new ItemNode(itemName, qty);;
-        newNode->next = top;
-        top = newNode;
+    bool holds(uint32_t itemId) const {
+        return itemId < byItem.size() && !byItem[itemId].empty();
     }
 
-    string pop() {
-    if (isEmpty()) {
-        throw runtime_error("No items in inventory to process!");
+    // Forget the item's first entry once it has emptied
+    void retire(uint32_t itemId) {
+        vector<ItemEntry>& own = byItem[itemId];
+        pop_heap(own.begin(), own.end(), greater<ItemEntry>());
+        own.pop_back();
+        live--;
     }
 
-    ItemNode* temp = top;
-    string name = temp->itemName;
-
-    if (temp->quantity > 1) {
-        temp->quantity--;
-    } else {
-        top = top->next;
-        delete temp;
+    void siftUp(size_t i) {
+        HeapEntry moving = at(i);
+        while (i > 0) {
+            size_t parent = (i - 1) / 4;
+            if (at(parent).key <= moving.key) break;
+            at(i) = at(parent);
+            i = parent;
+        }
+        at(i) = moving;
     }
 
-    return name;}
-
-
-    string peek() const {
-         if (isEmpty()) {
-            throw runtime_error("No incoming items.");
+    void siftDown(size_t i) {
+        size_t n = count();
+        HeapEntry moving = at(i);
+        while (true) {
+            size_t first = 4 * i + 1;
+            if (first >= n) break;
+            size_t last = min(first + 4, n);
+            size_t best = first;
+            for (size_t c = first + 1; c < last; c++) {
+                if (at(c).key < at(best).key) best = c;
+            }
+            if (at(best).key >= moving.key) break;
+            at(i) = at(best);
+            i = best;
         }
-        return top->itemName;
+        at(i) = moving;
     }
 
-    void displayAll() const {
-    if (isEmpty()) {
-        cout << "Inventory is empty." << endl;
-        return;
-    }
-    cout << "Inventory items (top to bottom): ";
-    ItemNode* current = top;
-    while (current != nullptr) {
-        cout << current->itemName <<  "(" << current->quantity << ") ";
-        current = current->next;
+    // Drop the emptied top entry and any emptied entries behind it
+    void popTop() {
+        do {
+            freeSlots.push_back(at(0).slot);
+            at(0) = heap.back();
+            heap.pop_back();
+            if (count() > 1) siftDown(0);
+        } while (count() > 0 && quantities[at(0).slot] == 0);
     }
-    cout << endl;
-}
-
-};
 
-// Queue class for outgoing shipments (FIFO)
-class ShippingQueue {
-private:
-    ItemNode* front;
-    ItemNode* rear;
+    // Arrival numbers have 32 bits; when they run out, drop the emptied
+    // entries and renumber the rest in order. A sorted array is already a
+    // valid heap, and so is each item's list rebuilt in that order.
+    void renumber() {
+        auto kept = remove_if(heap.begin() + ROOT, heap.end(), [this](const HeapEntry& e) {
+            if (quantities[e.slot] != 0) return false;
+            freeSlots.push_back(e.slot);
+            return true;
+        });
+        heap.erase(kept, heap.end());
+        sort(heap.begin() + ROOT, heap.end(),
+             [](const HeapEntry& a, const HeapEntry& b) { return a.key < b.key; });
+        for (vector<ItemEntry>& own : byItem) {
+            own.clear();
+        }
+        for (size_t i = 0; i < count(); i++) {
+            at(i).key = (at(i).key & ~uint64_t(0xFFFFFFFF)) | i;
+            byItem[at(i).itemId].push_back({at(i).key, at(i).slot});
+        }
+        nextArrival = count();
+    }
 
 public:
+    struct Entry {
+        uint32_t itemId;
+        int quantity;
+        ShipClass shipClass;
+        uint32_t deadline;
+    };
 
-    ItemNode* getFront() const { return front; }
+    PriorityShippingQueue() : heap(ROOT), live(0), nextArrival(0), units(0) {}
 
-    void setFront(ItemNode* node) { front = node; }
+    void clear() {
+        heap.resize(ROOT);
+        quantities.clear();
+        freeSlots.clear();
+        byItem.clear();
+        live = 0;
+        nextArrival = 0;
+        units = 0;
+    }
 
-    ShippingQueue() : front(nullptr), rear(nullptr) {}
+    bool isEmpty() const { return count() == 0; }
+    long long unitCount() const { return units; }
+    size_t entryCount() const { return live; }
 
-    ~ShippingQueue() {
-        while (!isEmpty()) {
-            dequeue();
+    // deadline is in whatever time unit the caller uses; later than
+    // NO_DEADLINE counts as none
+    void enqueue(uint32_t itemId, int qty, ShipClass shipClass, uint32_t deadline = NO_DEADLINE) {
+        if (nextArrival > 0xFFFFFFFF) renumber();
+        uint64_t key = (uint64_t(shipClass) << 62) | (uint64_t(min(deadline, NO_DEADLINE)) << 32) | nextArrival++;
+        uint32_t slot;
+        if (freeSlots.empty()) {
+            slot = static_cast<uint32_t>(quantities.size());
+            quantities.push_back(qty);
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            quantities[slot] = qty;
+        }
+        heap.push_back({key, itemId, slot});
+        siftUp(count() - 1);
+        if (itemId >= byItem.size()) {
+            byItem.resize(max<size_t>(itemId + 1, byItem.size() * 2));
         }
+        byItem[itemId].push_back({key, slot});
+        push_heap(byItem[itemId].begin(), byItem[itemId].end(), greater<ItemEntry>());
+        live++;
+        units += qty;
     }
 
-    bool isEmpty() const {
-        return front == nullptr;
+    uint32_t peek() const {
+        if (isEmpty()) {
+            throw runtime_error("No items in shipping queue.");
+        }
+        return at(0).itemId;
     }
 
-    void enqueue(string itemName,int qty = 1) {
-    if (!isEmpty() && rear->itemName == itemName) {
-        rear->quantity += qty;
-        return;
-    }
-    ItemNode* newNode = new ItemNode(itemName, qty);
-    if (isEmpty()) {
-        front = rear = newNode;
-    } else {
-        rear->next = newNode;
-        rear = newNode;
+    ShipClass peekClass() const {
+        if (isEmpty()) {
+            throw runtime_error("No items in shipping queue.");
+        }
+        return static_cast<ShipClass>(at(0).key >> 62);
     }
-}
 
-    string dequeue() {
+    uint32_t peekDeadline() const {
         if (isEmpty()) {
-            throw runtime_error("No items to ship.!");
+            throw runtime_error("No items in shipping queue.");
         }
+        return static_cast<uint32_t>(at(0).key >> 32) & NO_DEADLINE;
+    }
 
-        ItemNode* temp = front;
-        string name = temp->itemName;
-
-        if (temp->quantity > 1) {
-        temp->quantity--;
-    } else {
-        front = front->next;
-        if (front == nullptr) rear = nullptr;
-        delete temp;
+    // Every entry in shipping order; sorts a copy, so O(n log n)
+    vector<Entry> entries() const {
+        vector<HeapEntry> sorted;
+        sorted.reserve(live);
+        copy_if(heap.begin() + ROOT, heap.end(), back_inserter(sorted),
+                [this](const HeapEntry& e) { return quantities[e.slot] != 0; });
+        sort(sorted.begin(), sorted.end(), [](const HeapEntry& a, const HeapEntry& b) { return a.key < b.key; });
+        vector<Entry> result;
+        result.reserve(sorted.size());
+        for (const HeapEntry& e : sorted) {
+            result.push_back({e.itemId, quantities[e.slot], static_cast<ShipClass>(e.key >> 62),
+                              static_cast<uint32_t>(e.key >> 32) & NO_DEADLINE});
+        }
+        return result;
     }
 
-    return name;
+    // Quantity in the first entry to ship for this item, or 0 if it is not queued
+    int quantityOf(uint32_t itemId) const {
+        return holds(itemId) ? quantities[frontOf(itemId).second] : 0;
     }
 
+    // Take qty units from the first entry to ship for this item, dropping it
+    // when it empties
+    void take(uint32_t itemId, int qty) {
+        uint32_t slot = frontOf(itemId).second;
+        quantities[slot] -= qty;
+        units -= qty;
+        if (quantities[slot] == 0) {
+            retire(itemId);
+            if (at(0).slot == slot) popTop();
+        }
+    }
 
-    string peek() const {
+    uint32_t dequeue() {
         if (isEmpty()) {
-            throw runtime_error("No items in shipping queue.");
+            throw runtime_error("No items to ship.!");
+        }
+        uint32_t itemId = at(0).itemId;
+        units--;
+        if (--quantities[at(0).slot] == 0) {
+            retire(itemId);
+            popTop();
         }
-        return front->itemName;
+        return itemId;
     }
 
-    void displayAll() const {
-    if (isEmpty()) {
-        cout << "Shipping queue is empty." << endl;
-        return;
+    // Take up to n units of the first entry; returns how many were taken
+    // (0 when empty) and their item in itemId
+    int dequeueUpTo(int n, uint32_t& itemId) {
+        if (isEmpty()) return 0;
+        itemId = at(0).itemId;
+        int32_t& quantity = quantities[at(0).slot];
+        int taken = min(n, quantity);
+        units -= taken;
+        quantity -= taken;
+        if (quantity == 0) {
+            retire(itemId);
+            popTop();
+        }
+        return taken;
     }
-    cout << "Shipping queue items (front to rear): ";
-    ItemNode* current = front;
-    while (current != nullptr) {
-        cout << current->itemName <<  "(" << current->quantity << ") ";
-        current = current->next;
+};
+
+// One line of a shipment manifest: a run of units of the same item
+struct ManifestLine {
+    uint32_t itemId;
+    long long quantity;
+};
+
+// Calendar dates are kept as days since 1970-01-01 (UTC) and written as
+// YYYY-MM-DD; the conversions are the usual proleptic Gregorian ones
+int32_t daysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = static_cast<unsigned>(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int32_t>(doe) - 719468;
+}
+
+string formatDate(int32_t days) {
+    int64_t z = int64_t(days) + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    long long y = static_cast<long long>(yoe) + era * 400 + (m <= 2);
+    char text[32];
+    snprintf(text, sizeof(text), "%04lld-%02u-%02u", y, m, d);
+    return text;
+}
+
+// Parse a YYYY-MM-DD date; rejects anything else, including 2023-02-30
+bool parseDate(string_view text, int32_t& days) {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') return false;
+    int fields[3] = {0, 0, 0};
+    const size_t starts[3] = {0, 5, 8};
+    const size_t lengths[3] = {4, 2, 2};
+    for (int f = 0; f < 3; f++) {
+        for (size_t i = starts[f]; i < starts[f] + lengths[f]; i++) {
+            if (text[i] < '0' || text[i] > '9') return false;
+            fields[f] = fields[f] * 10 + (text[i] - '0');
+        }
     }
-    cout << endl;
+    if (fields[1] < 1 || fields[1] > 12 || fields[2] < 1 || fields[2] > 31) return false;
+    days = daysFromCivil(fields[0], static_cast<unsigned>(fields[1]), static_cast<unsigned>(fields[2]));
+    return formatDate(days) == text;  // catches days past the end of the month
 }
 
-};
+int32_t today() {
+    auto seconds = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    return static_cast<int32_t>(seconds / 86400);
+}
+
+// Stock received in lots with an expiry date. It is kept apart from the
+// LIFO inventory so it can be dispatched first-expired-first-out: all
+// lots sit in one tree ordered by (expiry, lot number), which the expiry
+// sweep walks from the front, and each item keeps a set of the keys of
+// its own lots, whose first element is the lot to dispatch next.
+class LotStore {
+public:
+    struct Lot {
+        uint64_t lotId;
+        uint32_t itemId;
+        int quantity;
+        int32_t received;   // days, see formatDate
+        int32_t expiry;
+    };
 
-// Warehouse System
-class WarehouseSystem {
 private:
-    InventoryStack inventory;
-    ShippingQueue shipping;
+    using LotKey = pair<int32_t, uint64_t>;  // expiry, lot number
 
-public:
-    bool isEmpty() const {
-        return inventory.isEmpty() && shipping.isEmpty();
+    map<LotKey, Lot> byExpiry;
+    vector<set<LotKey>> byItem;
+    unordered_map<uint64_t, int32_t> expiryOf;  // lot number -> expiry
+    long long units;
+
+    map<LotKey, Lot>::iterator erase(map<LotKey, Lot>::iterator it) {
+        byItem[it->second.itemId].erase(it->first);
+        expiryOf.erase(it->first.second);
+        units -= it->second.quantity;
+        return byExpiry.erase(it);
     }
 
-    void loadFromFile(const string& filename) {
-    ifstream infile(filename);
+public:
+    typedef map<LotKey, Lot>::const_iterator const_iterator;
 
-    if (!infile) {
-        cout << "No previous save found. Starting fresh." << endl;
-        return;
+    LotStore() : units(0) {}
+
+    // Iterates from the earliest expiry; entries are (key, Lot) pairs
+    const_iterator begin() const { return byExpiry.begin(); }
+    const_iterator end() const { return byExpiry.end(); }
+
+    long long unitCount() const { return units; }
+    size_t lotCount() const { return byExpiry.size(); }
+
+    bool isEmpty() const {
+        return byExpiry.empty();
     }
 
-    string line;
-    bool loadingInventory = false;
-    bool loadingShipping = false;
+    void clear() {
+        byExpiry.clear();
+        byItem.clear();
+        expiryOf.clear();
+        units = 0;
+    }
 
-    while (getline(infile, line)) {
-        if (line.find("--- Final Inventory ---") != string::npos) {
-            loadingInventory = true;
-            loadingShipping = false;
-            continue;
+    // Add units to a lot, creating it if it is new. False if the lot
+    // number is already in use for another item or expiry date.
+    bool receive(uint64_t lotId, uint32_t itemId, int qty, int32_t received, int32_t expiry) {
+        auto known = expiryOf.find(lotId);
+        if (known != expiryOf.end()) {
+            Lot& lot = byExpiry.at({known->second, lotId});
+            if (lot.itemId != itemId || lot.expiry != expiry) return false;
+            lot.quantity += qty;
+            units += qty;
+            return true;
         }
-        if (line.find("--- Final Shipping Queue ---") != string::npos) {
-            loadingInventory = false;
-            loadingShipping = true;
-            continue;
+        if (itemId >= byItem.size()) {
+            byItem.resize(max<size_t>(itemId + 1, byItem.size() * 2));
         }
+        byExpiry.emplace(LotKey(expiry, lotId), Lot{lotId, itemId, qty, received, expiry});
+        byItem[itemId].insert({expiry, lotId});
+        expiryOf[lotId] = expiry;
+        units += qty;
+        return true;
+    }
 
-        if (loadingInventory && line != "Inventory is empty.") {
-            // Push onto stack (LIFO)
-            inventory.push(line);
+    // Units of an item held in lots
+    long long unitsOf(uint32_t itemId) const {
+        long long total = 0;
+        if (itemId < byItem.size()) {
+            for (const LotKey& key : byItem[itemId]) {
+                total += byExpiry.at(key).quantity;
+            }
         }
-        if (loadingShipping && line != "Shipping queue is empty.") {
-            // Enqueue into queue (FIFO)
-            shipping.enqueue(line);
+        return total;
+    }
+
+    // Take up to qty units of an item from its earliest-expiring lots and
+    // return how many were taken; the lots drawn on are appended to `from`
+    // as (lot number, units) when it is given
+    int takeEarliest(uint32_t itemId, int qty, vector<pair<uint64_t, int>>* from = nullptr) {
+        int taken = 0;
+        while (taken < qty && itemId < byItem.size() && !byItem[itemId].empty()) {
+            auto it = byExpiry.find(*byItem[itemId].begin());
+            int part = min(qty - taken, it->second.quantity);
+            if (from != nullptr) from->push_back({it->first.second, part});
+            taken += part;
+            if (part == it->second.quantity) {
+                erase(it);
+            } else {
+                it->second.quantity -= part;
+                units -= part;
+            }
         }
+        return taken;
     }
 
-    infile.close();
-    cout << "Previous data loaded from " << filename << endl;
+    // Drop every lot that expires before `before`, visiting only those;
+    // returns the units dropped and sets lotsDropped
+    long long expireBefore(int32_t before, size_t& lotsDropped) {
+        long long dropped = 0;
+        lotsDropped = 0;
+        auto it = byExpiry.begin();
+        while (it != byExpiry.end() && it->first.first < before) {
+            dropped += it->second.quantity;
+            lotsDropped++;
+            it = erase(it);
+        }
+        return dropped;
+    }
+};
+
+// A lot as written in text saves: quantity, lot number, received and
+// expiry dates and the item name, separated by tabs
+string formatLotLine(const LotStore::Lot& lot) {
+    return to_string(lot.quantity) + '\t' + to_string(lot.lotId) + '\t' + formatDate(lot.received) + '\t'
+           + formatDate(lot.expiry) + '\t' + skuDictionary().name(lot.itemId);
 }
 
-    void addItem(string itemName,int qty) {
-        inventory.push(itemName,qty);
-         cout << "Item \"" << itemName << "\" added to inventory. Quantity: " << qty << endl;
+bool parseLotLine(const string& line, LotStore::Lot& lot) {
+    string fields[5];
+    size_t start = 0;
+    for (int f = 0; f < 4; f++) {
+        size_t tab = line.find('\t', start);
+        if (tab == string::npos) return false;
+        fields[f] = line.substr(start, tab - start);
+        start = tab + 1;
     }
+    fields[4] = line.substr(start);
 
-    void processItem() {
-         try {
-            string itemName = inventory.pop();
-            shipping.enqueue(itemName);
-            cout << "Processed \"" << itemName << "\" and added to shipping queue." << endl;
-        } catch (const runtime_error& e) {
-            cout << e.what() << endl;
-        }
+    char* end = nullptr;
+    long qty = strtol(fields[0].c_str(), &end, 10);
+    if (fields[0].empty() || *end != '\0' || qty <= 0 || qty > numeric_limits<int>::max()) return false;
+    lot.lotId = strtoull(fields[1].c_str(), &end, 10);
+    if (fields[1].empty() || *end != '\0') return false;
+    if (!parseDate(fields[2], lot.received) || !parseDate(fields[3], lot.expiry)) return false;
+    lot.quantity = static_cast<int>(qty);
+    lot.itemId = skuDictionary().intern(canonicalItemName(fields[4]));
+    return true;
+}
+
+// How processing picks the dock each entry moved off the inventory goes to
+enum DockPolicy { DOCK_ROUND_ROBIN, DOCK_LEAST_LOADED, DOCK_SKU_AFFINITY };
+
+const size_t MAX_DOCKS = 64;
+
+// Per-dock totals since the docks were configured
+struct DockStats {
+    long long shipped = 0;
+    long long stolen = 0;   // units taken from the back of other docks
+};
+
+const char* dockPolicyName(DockPolicy policy) {
+    switch (policy) {
+        case DOCK_LEAST_LOADED:
+            return "least-loaded";
+        case DOCK_SKU_AFFINITY:
+            return "sku";
+        default:
+            return "round-robin";
     }
+}
 
-    void shipItem() {
-        try {
-            string itemName = shipping.dequeue();
-            cout << "Shipping item: " << itemName << endl;
-        } catch (const runtime_error& e) {
-            cout << e.what() << endl;
+bool parseDockPolicy(const string& name, DockPolicy& policy) {
+    for (DockPolicy candidate : {DOCK_ROUND_ROBIN, DOCK_LEAST_LOADED, DOCK_SKU_AFFINITY}) {
+        if (name == dockPolicyName(candidate)) {
+            policy = candidate;
+            return true;
         }
     }
+    return false;
+}
 
-    void viewLastIncoming() const {
-         try {
-            cout << "Last incoming item: " << inventory.peek() << endl;
-        } catch (const runtime_error& e) {
-            cout << e.what() << endl;
-        }
+// Class and ship-by day that an item's units are queued with under
+// priority shipping; the deadline counts days like the lot dates
+struct ShipTerms {
+    ShipClass shipClass = SHIP_STANDARD;
+    uint32_t deadline = PriorityShippingQueue::NO_DEADLINE;
+
+    bool operator==(const ShipTerms& other) const {
+        return shipClass == other.shipClass && deadline == other.deadline;
     }
+    bool operator!=(const ShipTerms& other) const { return !(*this == other); }
+};
 
-    void viewNextShipment() const {
-        try {
-            cout << "Next item to ship: " << shipping.peek() << endl;
-        } catch (const runtime_error& e) {
-            cout << e.what() << endl;
+const char* shipClassName(ShipClass shipClass) {
+    switch (shipClass) {
+        case SHIP_EXPRESS:
+            return "express";
+        case SHIP_ECONOMY:
+            return "economy";
+        default:
+            return "standard";
+    }
+}
+
+bool parseShipClass(string_view name, ShipClass& shipClass) {
+    for (ShipClass candidate : {SHIP_EXPRESS, SHIP_STANDARD, SHIP_ECONOMY}) {
+        if (name == shipClassName(candidate)) {
+            shipClass = candidate;
+            return true;
         }
     }
+    return false;
+}
 
-    void viewAll() const {
-    cout << "\n--- Current Inventory ---" << endl;
-    inventory.displayAll();
-    cout << "--- Current Shipping Queue ---" << endl;
-    shipping.displayAll();
+// A ship-by date as YYYY-MM-DD, or "-" for none
+string formatDeadline(uint32_t deadline) {
+    return deadline == PriorityShippingQueue::NO_DEADLINE ? "-" : formatDate(static_cast<int32_t>(deadline));
 }
 
-// Search for an item in Inventory Stack and Shipping Queue
-void searchItem(const string& name) const {
-    try {
-         // Search in Inventory (stack)
-        ItemNode* cur = inventory.getTop();
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                cout << "Found in Inventory: " << name
-                     << " (" << cur->quantity << ")" << endl;
-                return;// Stop once found
-            }
-            cur = cur->next;// Move to next node
-        }
+bool parseDeadline(string_view text, uint32_t& deadline) {
+    int32_t days;
+    if (text == "-") {
+        deadline = PriorityShippingQueue::NO_DEADLINE;
+        return true;
+    }
+    if (!parseDate(text, days) || days < 0 || static_cast<uint32_t>(days) >= PriorityShippingQueue::NO_DEADLINE) {
+        return false;
+    }
+    deadline = static_cast<uint32_t>(days);
+    return true;
+}
 
-        // Search in Shipping Queue
-        cur = shipping.getFront();
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                cout << "Found in Shipping Queue: " << name
-                     << " (" << cur->quantity << ")" << endl;
-                return;// Stop once found
-            }
-            cur = cur->next;
-        }
+// "express, ship by 2026-10-20", or just the class without a deadline
+string describeTerms(ShipClass shipClass, uint32_t deadline) {
+    string text = shipClassName(shipClass);
+    if (deadline != PriorityShippingQueue::NO_DEADLINE) text += ", ship by " + formatDeadline(deadline);
+    return text;
+}
 
-        // If not found in both structures, throw error
-        throw runtime_error("Item not found: " + name);
+// Shipping terms as written in text saves: class, ship-by date and the
+// item name, separated by tabs. Priority queue entries are written the
+// same way after their quantity and a tab.
+string formatTermsLine(uint32_t itemId, ShipClass shipClass, uint32_t deadline) {
+    return string(shipClassName(shipClass)) + '\t' + formatDeadline(deadline) + '\t' + skuDictionary().name(itemId);
+}
 
-    } catch (const runtime_error& e) {
+// Parse the terms fields of line from offset start on
+bool parseTermsLine(const string& line, size_t start, uint32_t& itemId, ShipTerms& terms) {
+    size_t first = line.find('\t', start);
+    size_t second = first == string::npos ? string::npos : line.find('\t', first + 1);
+    if (second == string::npos) return false;
+    string_view text(line);
+    if (!parseShipClass(text.substr(start, first - start), terms.shipClass)
+            || !parseDeadline(text.substr(first + 1, second - first - 1), terms.deadline)) {
+        return false;
+    }
+    itemId = skuDictionary().intern(canonicalItemName(line.substr(second + 1)));
+    return true;
+}
 
-        // Handle the error message here
-        cout << e.what() << endl;
+bool parseShipmentLine(const string& line, PriorityShippingQueue::Entry& entry) {
+    size_t tab = line.find('\t');
+    char* end = nullptr;
+    long qty = strtol(line.c_str(), &end, 10);
+    if (tab == string::npos || end != line.c_str() + tab || qty <= 0 || qty > numeric_limits<int>::max()) {
+        return false;
     }
+    ShipTerms terms;
+    if (!parseTermsLine(line, tab + 1, entry.itemId, terms)) return false;
+    entry.quantity = static_cast<int>(qty);
+    entry.shipClass = terms.shipClass;
+    entry.deadline = terms.deadline;
+    return true;
 }
 
-// Remove an item by name (from Inventory or Shipping Queue)
-void removeItem(const string& name) {
-    try {
+// Warehouse System
+class WarehouseSystem {
+private:
+    NodePool pool;  // declared first so it outlives the containers
+    InventoryStack inventory;
+    LotStore lots;                // lot-tracked stock, dispatched by expiry
+    deque<ShippingQueue> docks;   // one shipping queue per dock door, never empty
+    PriorityShippingQueue priority;  // the shipping queue of every dock while priorityShipping is set
+    bool priorityShipping;
+    vector<ShipTerms> shipTerms;  // by item id; standard terms past the end
+    DockPolicy dockPolicy;
+    size_t nextDock;              // round-robin cursor
+    vector<DockStats> dockStats;
+    chrono::steady_clock::time_point dockStatsSince;
+    Journal journal;
+    uint64_t snapshotGeneration;  // journal position covered by the loaded snapshot
+    uint64_t snapshotOffset;
 
-        // Search in Inventory (stack)
-        ItemNode* cur = inventory.getTop();
-        ItemNode* prev = nullptr;
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                if (cur->quantity > 1) {
-
-                    // If quantity > 1, just decrease by 1
-                    cur->quantity--;
-                } else {
+    // Background checkpoints, see checkpointIfDue
+    string checkpointText;        // empty while checkpoints are off
+    string checkpointSnapshot;
+    chrono::steady_clock::duration checkpointInterval;
+    chrono::steady_clock::time_point lastCheckpoint;
+    uint64_t checkpointGeneration;  // journal position the latest checkpoint covers
+    uint64_t checkpointOffset;
+    string journalTail;           // records journaled since the latest checkpoint began
+    CheckpointWriter<WarehouseSystem> checkpoints;
 
-                    // If only one item, remove node completely
-                    if (prev == nullptr) {
+    static constexpr size_t NO_DOCK = ~size_t(0);
 
-                        // Remove top node
-                        inventory.setTop(cur->next);
-                    } else {
+    void ensureDocks(size_t count) {
+        while (docks.size() < count) {
+            docks.emplace_back(pool);
+        }
+        dockStats.resize(docks.size());
+    }
 
-                        // Bypass the current node
-                        prev->next = cur->next;
-                    }
-                    delete cur;
+    // Dock for an entry of itemId leaving the inventory, by dockPolicy
+    size_t routeDock(uint32_t itemId) {
+        if (docks.size() == 1) return 0;
+        switch (dockPolicy) {
+            case DOCK_LEAST_LOADED: {
+                size_t best = 0;
+                for (size_t d = 1; d < docks.size(); d++) {
+                    if (docks[d].unitCount() < docks[best].unitCount()) best = d;
                 }
-                cout << "Removed \"" << name << "\" from Inventory." << endl;
-                return;
+                return best;
             }
-            prev = cur;// Keep track of previous node
-            cur = cur->next; // Move to next node
+            case DOCK_SKU_AFFINITY:
+                return itemId % docks.size();
+            default:
+                return nextDock++ % docks.size();
         }
+    }
 
-        // Search in Shipping Queue
-        cur = shipping.getFront();
-        prev = nullptr;
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                if (cur->quantity > 1) {
-
-                    // If quantity > 1, just decrease by 1
-                    cur->quantity--;
-                } else {
+    // Refill an empty dock with about half the units at the back of the
+    // most loaded one; false if every other dock is empty too. The choice
+    // depends only on the queues, so replaying a ship repeats it.
+    bool stealInto(size_t thief) {
+        size_t victim = NO_DOCK;
+        for (size_t d = 0; d < docks.size(); d++) {
+            if (d != thief && docks[d].unitCount() > (victim == NO_DOCK ? 0 : docks[victim].unitCount())) {
+                victim = d;
+            }
+        }
+        if (victim == NO_DOCK) return false;
 
-                     // If only one item, remove node completely
-                    if (prev == nullptr) {
+        long long want = (docks[victim].unitCount() + 1) / 2;
+        vector<ManifestLine> runs;  // rear first
+        while (want > 0) {
+            uint32_t itemId = docks[victim].peekBack();
+            int qty = static_cast<int>(min<long long>(docks[victim].rearQuantity(), want));
+            docks[victim].takeBack(qty);
+            runs.push_back({itemId, qty});
+            want -= qty;
+        }
+        for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+            docks[thief].enqueue(it->itemId, static_cast<int>(it->quantity));
+            dockStats[thief].stolen += it->quantity;
+        }
+        return true;
+    }
 
-                         // Remove front node
-                        shipping.setFront(cur->next);
-                    } else {
-                        prev->next = cur->next;
-                    }
-                    delete cur;
-                }
-                cout << "Removed \"" << name << "\" from Shipping Queue." << endl;
-                return;
-            }
-            prev = cur;
-            cur = cur->next;
+    // First dock holding an item, or NO_DOCK
+    size_t dockHolding(uint32_t itemId) const {
+        for (size_t d = 0; d < docks.size(); d++) {
+            if (docks[d].quantityOf(itemId) > 0) return d;
         }
+        return NO_DOCK;
+    }
 
-        throw runtime_error("Item not found: " + name);
+    ShipTerms termsOf(uint32_t itemId) const {
+        return itemId < shipTerms.size() ? shipTerms[itemId] : ShipTerms();
+    }
 
-    } catch (const runtime_error& e) {
-        cout << e.what() << endl;
+    void applyTerms(uint32_t itemId, const ShipTerms& terms) {
+        if (itemId >= shipTerms.size()) {
+            if (terms == ShipTerms()) return;
+            shipTerms.resize(itemId + 1);
+        }
+        shipTerms[itemId] = terms;
     }
-}
 
-// Count total items (Inventory + Shipping Queue)
-void countItems() const {
-    int count = 0;
+    // Queue units for shipping: at the rear of a dock, or by the item's
+    // terms while priority shipping is on
+    void queueForShipping(uint32_t itemId, int qty, size_t dock) {
+        if (priorityShipping) {
+            ShipTerms terms = termsOf(itemId);
+            priority.enqueue(itemId, qty, terms.shipClass, terms.deadline);
+        } else {
+            docks[dock].enqueue(itemId, qty);
+        }
+    }
 
-    // Count items in Inventory (stack)
-    ItemNode* cur = inventory.getTop();
-    while (cur != nullptr) {
-        count += cur->quantity;
-        cur = cur->next;
+    // Change the shipping queue, moving what is queued across in shipping
+    // order: dock by dock into the priority queue (by each item's terms),
+    // or out of it onto the first dock
+    void switchShipping(bool on) {
+        if (on == priorityShipping) return;
+        priorityShipping = on;
+        if (on) {
+            for (ShippingQueue& dock : docks) {
+                for (const auto& entry : dock) {
+                    queueForShipping(entry.itemId, entry.quantity, 0);
+                }
+                dock.clear();
+            }
+        } else {
+            for (const PriorityShippingQueue::Entry& entry : priority.entries()) {
+                docks[0].enqueue(entry.itemId, entry.quantity);
+            }
+            priority.clear();
+        }
     }
 
-    // Count items in Shipping Queue
-    cur = shipping.getFront();
-    while (cur != nullptr) {
-        count += cur->quantity;
-        cur = cur->next;
+    // Move up to qty units of an item from its earliest-expiring lots to
+    // the rear of a dock; returns how many moved
+    int moveLotUnits(uint32_t itemId, int qty, size_t dock, vector<pair<uint64_t, int>>* from = nullptr) {
+        int moved = lots.takeEarliest(itemId, qty, from);
+        if (moved > 0) queueForShipping(itemId, moved, dock);
+        return moved;
     }
-    cout << "Total items in system: " << count << endl;
-}
 
+    // Move qty units of the topmost entry for itemId to the rear of a dock
+    void moveToShipping(uint32_t itemId, int qty, size_t dock) {
+#if !defined(WAREHOUSE_VECTOR_STACK) && !defined(WAREHOUSE_RING_QUEUE)
+        if (!priorityShipping && inventory.quantityOf(itemId) == qty) {
+            // Both sides are lists over the same pool: relink the node itself
+            docks[dock].enqueueNode(inventory.detach(itemId));
+            return;
+        }
+#endif
+        inventory.take(itemId, qty);
+        queueForShipping(itemId, qty, dock);
+    }
 
-void saveToFile(const string& filename) const {
-    ofstream outfile(filename);
+    // Move up to n units off the top of the inventory; returns how many moved.
+    // Entries go to `dock`, or where dockPolicy routes them for NO_DOCK.
+    // If records is given, the moves are appended to it as "P qty dock"
+    // journal lines, one per run of entries sent to the same dock.
+    long long processUnits(long long n, size_t dock = NO_DOCK, string* records = nullptr) {
+        long long moved = 0;
+        size_t runDock = NO_DOCK;
+        long long runUnits = 0;
+        while (moved < n && !inventory.isEmpty()) {
+            uint32_t itemId = inventory.peek();
+            int qty = inventory.quantityOf(itemId);
+            if (qty > n - moved) qty = static_cast<int>(n - moved);
+            size_t target = priorityShipping ? 0 : dock != NO_DOCK ? dock : routeDock(itemId);
+            moveToShipping(itemId, qty, target);
+            moved += qty;
 
-    if (!outfile) {
-        cout << "Error: Could not open file for writing!" << endl;
-        return;
+            if (records != nullptr && target != runDock) {
+                if (runUnits > 0) *records += "P " + to_string(runUnits) + " " + to_string(runDock) + "\n";
+                runDock = target;
+                runUnits = 0;
+            }
+            runUnits += qty;
+        }
+        if (records != nullptr && runUnits > 0) {
+            *records += "P " + to_string(runUnits) + " " + to_string(runDock) + "\n";
+        }
+        return moved;
     }
 
-    outfile << "--- Final Inventory ---" << endl;
-    if (inventory.isEmpty()) {
-        outfile << "Inventory is empty." << endl;
-    } else {
-        ItemNode* current = inventory.getTop();  // need access
-        while (current != nullptr) {
-            outfile << current->itemName << endl;
-            current = current->next;
+    // Write the text save to a temporary file and swap it in
+    void writeTextFile(const string& filename) const {
+        string tmp = filename + ".tmp";
+        ofstream outfile(tmp);
+        if (!outfile) {
+            throw runtime_error("Error: Could not open file for writing!");
         }
-    };
 
-    outfile << "--- Final Shipping Queue ---" << endl;
-    if (shipping.isEmpty()) {
-        outfile << "Shipping queue is empty." << endl;
-    } else {
-        ItemNode* current = shipping.getFront();  // need access
-        while (current != nullptr) {
-            outfile << current->itemName << endl;
-            current = current->next;
+        outfile << TEXT_SAVE_HEADER << '\n';
+        outfile << "--- Final Inventory ---" << '\n';
+        if (inventory.isEmpty()) {
+            outfile << "Inventory is empty." << '\n';
+        } else {
+            for (const auto& entry : inventory) {
+                outfile << entry.quantity << '\t' << skuDictionary().name(entry.itemId) << '\n';
+            }
+        }
+
+        for (size_t d = 0; d < docks.size(); d++) {
+            if (d == 0) {
+                outfile << "--- Final Shipping Queue ---" << '\n';
+            } else {
+                outfile << "--- Shipping Dock " << d + 1 << " ---" << '\n';
+            }
+            if (docks[d].isEmpty()) {
+                outfile << "Shipping queue is empty." << '\n';
+            } else {
+                for (const auto& entry : docks[d]) {
+                    outfile << entry.quantity << '\t' << skuDictionary().name(entry.itemId) << '\n';
+                }
+            }
+        }
+        if (priorityShipping) {
+            outfile << "--- Priority Shipping Queue ---" << '\n';
+            if (priority.isEmpty()) {
+                outfile << "Shipping queue is empty." << '\n';
+            }
+            for (const PriorityShippingQueue::Entry& entry : priority.entries()) {
+                outfile << entry.quantity << '\t' << formatTermsLine(entry.itemId, entry.shipClass, entry.deadline)
+                        << '\n';
+            }
+        }
+        bool termsHeader = false;
+        for (uint32_t id = 0; id < shipTerms.size(); id++) {
+            if (shipTerms[id] == ShipTerms()) continue;
+            if (!termsHeader) outfile << "--- Shipping Terms ---" << '\n';
+            termsHeader = true;
+            outfile << formatTermsLine(id, shipTerms[id].shipClass, shipTerms[id].deadline) << '\n';
         }
+        if (!lots.isEmpty()) {
+            outfile << "--- Lots ---" << '\n';
+            for (const auto& entry : lots) {
+                outfile << formatLotLine(entry.second) << '\n';
+            }
+        }
+
+        outfile.close();
+        if (!outfile) {
+            throw runtime_error("Error: Could not write " + tmp);
+        }
+        commitFile(tmp, filename);
     }
 
-    outfile.close();
-    cout << "Final result saved to " << filename << endl;
-}
+    // Both containers as a binary snapshot (see SnapshotHeader), recording
+    // the journal position
+    string snapshotImage() const {
+        vector<uint32_t> localIds(skuDictionary().size(), SkuDictionary::NO_ID);
+        vector<uint32_t> usedIds;
+        vector<SnapshotRecord> records;
+        vector<uint64_t> dockCounts;
+        vector<SnapshotLot> lotRecords;
+        vector<SnapshotShipment> shipments;
+        vector<SnapshotTerms> termRecords;
+        records.reserve(inventory.entryCount() + shippingEntries());
+        auto localId = [&](uint32_t itemId) {
+            if (localIds[itemId] == SkuDictionary::NO_ID) {
+                localIds[itemId] = static_cast<uint32_t>(usedIds.size());
+                usedIds.push_back(itemId);
+            }
+            return localIds[itemId];
+        };
 
+        for (const auto& entry : inventory) {
+            records.push_back({localId(entry.itemId), entry.quantity});
+        }
+        for (const ShippingQueue& dock : docks) {
+            for (const auto& entry : dock) {
+                records.push_back({localId(entry.itemId), entry.quantity});
+            }
+            dockCounts.push_back(dock.entryCount());
+        }
+        for (const auto& entry : lots) {
+            const LotStore::Lot& lot = entry.second;
+            lotRecords.push_back({lot.lotId, localId(lot.itemId), lot.quantity, lot.received, lot.expiry});
+        }
+        for (const PriorityShippingQueue::Entry& entry : priority.entries()) {
+            shipments.push_back({localId(entry.itemId), entry.quantity, entry.shipClass, entry.deadline});
+        }
+        for (uint32_t id = 0; id < shipTerms.size(); id++) {
+            if (shipTerms[id] != ShipTerms()) {
+                termRecords.push_back({localId(id), shipTerms[id].shipClass, shipTerms[id].deadline});
+            }
+        }
 
+        SnapshotHeader header;
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.nameCount = static_cast<uint32_t>(usedIds.size());
+        header.nameBytes = 0;
+        header.stackCount = inventory.entryCount();
+        header.queueCount = shippingEntries() - priority.entryCount();
+        header.journalGeneration = journal.isOpen() ? journal.generation() : snapshotGeneration;
+        header.journalOffset = journal.isOpen() ? journal.size() : snapshotOffset;
+        header.dockCount = docks.size();
+        header.lotCount = lotRecords.size();
+        header.priorityCount = shipments.size();
+        header.termsCount = termRecords.size();
+        header.priorityShipping = priorityShipping ? 1 : 0;
+        header.reserved = 0;
 
-};
+        vector<uint64_t> offsets;
+        offsets.reserve(usedIds.size() + 1);
+        offsets.push_back(0);
+        for (uint32_t id : usedIds) {
+            header.nameBytes += skuDictionary().name(id).size();
+            offsets.push_back(header.nameBytes);
+        }
 
-// Function to display menu for Warehouse System
+        string buffer;
+        buffer.reserve(sizeof(header) + (dockCounts.size() + offsets.size()) * sizeof(uint64_t)
+                       + header.nameBytes + 8 + records.size() * sizeof(SnapshotRecord)
+                       + lotRecords.size() * sizeof(SnapshotLot) + shipments.size() * sizeof(SnapshotShipment)
+                       + termRecords.size() * sizeof(SnapshotTerms));
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        buffer.append(reinterpret_cast<const char*>(dockCounts.data()), dockCounts.size() * sizeof(uint64_t));
+        buffer.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        for (uint32_t id : usedIds) {
+            buffer += skuDictionary().name(id);
+        }
+        buffer.append(((header.nameBytes + 7) & ~uint64_t(7)) - header.nameBytes, '\0');
+        buffer.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SnapshotRecord));
+        buffer.append(reinterpret_cast<const char*>(lotRecords.data()), lotRecords.size() * sizeof(SnapshotLot));
+        buffer.append(reinterpret_cast<const char*>(shipments.data()), shipments.size() * sizeof(SnapshotShipment));
+        buffer.append(reinterpret_cast<const char*>(termRecords.data()), termRecords.size() * sizeof(SnapshotTerms));
+        return buffer;
+    }
+
+    // Write snapshotImage to a temporary file and swap it in; buffered
+    // journal records must be flushed first
+    void writeSnapshotFile(const string& filename) const {
+        string buffer = snapshotImage();
+        string tmp = filename + ".tmp";
+        ofstream outfile(tmp, ios::binary);
+        if (!outfile) {
+            throw runtime_error("Error: Could not open file for writing!");
+        }
+        outfile.write(buffer.data(), buffer.size());
+        outfile.close();
+        if (!outfile) {
+            throw runtime_error("Error: Could not write " + tmp);
+        }
+        commitFile(tmp, filename);
+    }
+
+    // Hand the records journaled since the last checkpoint to the writer
+    // thread, which replays them into its replica and writes both files from
+    // there. The journal is flushed first so the checkpoint never covers
+    // records that are not on disk yet.
+    void startCheckpoint() {
+        try {
+            journal.flush();
+            checkpointGeneration = journal.generation();
+            checkpointOffset = journal.size();
+            lastCheckpoint = chrono::steady_clock::now();
+            checkpoints.begin(journalTail, checkpointGeneration, checkpointOffset);
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    // Collect a finished checkpoint, blocking until it ends if wait is set
+    void pollCheckpoint(bool wait) {
+        bool written = false;
+        if (!checkpoints.collect(wait, written)) return;
+        if (!written) {
+            cout << "Checkpoint to " << checkpointSnapshot << " failed." << endl;
+            checkpointGeneration = checkpointOffset = 0;  // retry at the next interval
+            return;
+        }
+        try {
+            checkpointDone();
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    // The snapshot on disk now covers the journal up to checkpointOffset:
+    // carry only the records after it into the next journal generation
+    void checkpointDone() {
+        if (journal.isOpen() && journal.generation() == checkpointGeneration) {
+            journal.restart(checkpointGeneration + 1, checkpointOffset);
+            checkpointGeneration = journal.generation();
+            checkpointOffset = journal.size();
+        }
+    }
+
+    // Push the parsed blocks of one chunk in input order and journal them
+    // as one group
+    void applyReceipts(vector<future<ReceiptBlock>>& blocks, size_t& lineBase, ImportStats& stats) {
+        string records;
+        for (auto& pending : blocks) {
+            ReceiptBlock block = pending.get();
+            for (const ReceiptRow& row : block.rows) {
+                inventory.push(skuDictionary().intern(string(row.name, row.length)), row.qty);
+            }
+            records += block.records;
+            stats.rows += block.rows.size();
+            if (block.rejected > 0 && stats.rejected == 0) {
+                stats.firstRejected = lineBase + block.firstRejected;
+            }
+            stats.rejected += block.rejected;
+            lineBase += block.lines;
+        }
+        blocks.clear();
+        journal.recordBatch(records);
+    }
+
+    // Take one unit of an item, from the inventory first, then the
+    // earliest-expiring lot, then shipping, as removeItem does
+    void removeOne(uint32_t itemId) {
+        size_t dock;
+        if (inventory.quantityOf(itemId) > 0) {
+            inventory.take(itemId, 1);
+        } else if (lots.unitsOf(itemId) > 0) {
+            lots.takeEarliest(itemId, 1);
+        } else if ((dock = dockHolding(itemId)) != NO_DOCK) {
+            docks[dock].take(itemId, 1);
+        } else if (priority.quantityOf(itemId) > 0) {
+            priority.take(itemId, 1);
+        }
+    }
+
+    size_t shippingEntries() const {
+        size_t entries = priority.entryCount();
+        for (const ShippingQueue& dock : docks) {
+            entries += dock.entryCount();
+        }
+        return entries;
+    }
+
+    long long shippingUnits() const {
+        long long units = priority.unitCount();
+        for (const ShippingQueue& dock : docks) {
+            units += dock.unitCount();
+        }
+        return units;
+    }
+
+public:
+    WarehouseSystem()
+        : inventory(pool), priorityShipping(false), dockPolicy(DOCK_ROUND_ROBIN), nextDock(0), snapshotGeneration(0),
+          snapshotOffset(0), checkpointInterval(0), checkpointGeneration(0), checkpointOffset(0) {
+        ensureDocks(1);
+    }
+
+    ~WarehouseSystem() {
+        finishCheckpoint();
+    }
+
+    // Checkpoint to these files from checkpointIfDue, at most once per
+    // interval. Needs the journal open, since the checkpoint writer follows
+    // the warehouse through its records; call once.
+    void enableCheckpoints(const string& textFile, const string& snapshotFile,
+                           chrono::steady_clock::duration interval) {
+        if (!journal.isOpen() || checkpoints.started()) return;
+        checkpointText = textFile;
+        checkpointSnapshot = snapshotFile;
+        checkpointInterval = interval;
+        lastCheckpoint = chrono::steady_clock::now();
+        checkpoints.start(snapshotImage(), textFile, snapshotFile);
+        journal.tap(&journalTail);
+    }
+
+    // Call between commands: reaps a finished checkpoint and starts the next
+    // one once the interval has passed and the journal has grown since
+    void checkpointIfDue() {
+        pollCheckpoint(false);
+        if (checkpointText.empty() || !journal.isOpen() || checkpoints.running()) return;
+        if (chrono::steady_clock::now() - lastCheckpoint < checkpointInterval) return;
+        if (journal.generation() == checkpointGeneration && journal.size() == checkpointOffset) return;
+        startCheckpoint();
+    }
+
+    // Wait for a running checkpoint; call before writing its files directly
+    void finishCheckpoint() {
+        pollCheckpoint(true);
+    }
+
+    // Write out journal records held back by the group policy
+    void flushJournal() {
+        try {
+            journal.flush();
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    const NodePool& nodePool() const { return pool; }
+
+    // Use at least count docks (loaded data may already have more) and
+    // route processing by policy; restarts the dock statistics
+    void configureDocks(size_t count, DockPolicy policy) {
+        ensureDocks(min(max<size_t>(count, 1), MAX_DOCKS));
+        dockPolicy = policy;
+        nextDock = 0;
+        dockStats.assign(docks.size(), DockStats());
+        dockStatsSince = chrono::steady_clock::now();
+    }
+
+    size_t dockCount() const { return docks.size(); }
+
+    // Empty every container and hand the node slabs back in one go
+    void clear() {
+        inventory.clear();
+        lots.clear();
+        for (ShippingQueue& dock : docks) {
+            dock.clear();
+        }
+        priority.clear();
+        pool.releaseAll();
+    }
+
+    bool isEmpty() const {
+        return inventory.isEmpty() && lots.isEmpty() && shippingUnits() == 0;
+    }
+
+    // False if the file is there but could not be read, in which case the
+    // warehouse is left as it was
+    bool loadFromFile(const string& filename) {
+    NameFolds folds;
+    MappedFile snapshot;
+    if (snapshot.open(filename) && snapshot.size() >= sizeof(SNAPSHOT_MAGIC)
+            && memcmp(snapshot.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0) {
+        try {
+            loadSnapshot(snapshot.data(), snapshot.size(), folds);
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+            return false;
+        }
+        cout << "Previous data loaded from " << filename << endl;
+        folds.report(filename);
+        return true;
+    }
+
+    ifstream infile(filename);
+
+    if (!infile) {
+        cout << "No previous save found. Starting fresh." << endl;
+        return true;
+    }
+
+    string line;
+    bool loadingInventory = false;
+    bool loadingShipping = false;
+    bool loadingLots = false;
+    bool loadingPriority = false;
+    bool loadingTerms = false;
+    bool withQuantities = false;
+    bool priorityMode = false;
+    size_t loadingDock = 0;
+    // Runs are collected first so a bad line leaves the containers untouched
+    vector<pair<uint32_t, int>> stackRuns;
+    vector<vector<pair<uint32_t, int>>> queueRuns(1);  // per dock
+    vector<LotStore::Lot> lotRuns;
+    vector<PriorityShippingQueue::Entry> shipmentRuns;
+    vector<pair<uint32_t, ShipTerms>> termRuns;
+
+    if (getline(infile, line) && line == TEXT_SAVE_HEADER) {
+        withQuantities = true;
+    } else {
+        infile.clear();
+        infile.seekg(0);
+    }
+
+    while (getline(infile, line)) {
+        if (line.find("--- Final Inventory ---") != string::npos) {
+            loadingInventory = true;
+            loadingShipping = false;
+            loadingLots = loadingPriority = loadingTerms = false;
+            continue;
+        }
+        if (line.find("--- Final Shipping Queue ---") != string::npos) {
+            loadingInventory = false;
+            loadingShipping = true;
+            loadingLots = loadingPriority = loadingTerms = false;
+            loadingDock = 0;
+            continue;
+        }
+        if (withQuantities && line == "--- Lots ---") {
+            loadingInventory = false;
+            loadingShipping = false;
+            loadingLots = true;
+            loadingPriority = loadingTerms = false;
+            continue;
+        }
+        if (withQuantities && line == "--- Priority Shipping Queue ---") {
+            loadingInventory = loadingShipping = loadingLots = loadingTerms = false;
+            loadingPriority = true;
+            priorityMode = true;
+            continue;
+        }
+        if (withQuantities && line == "--- Shipping Terms ---") {
+            loadingInventory = loadingShipping = loadingLots = loadingPriority = false;
+            loadingTerms = true;
+            continue;
+        }
+        if (loadingPriority) {
+            PriorityShippingQueue::Entry entry;
+            if (line == "Shipping queue is empty.") continue;
+            if (!parseShipmentLine(line, entry)) {
+                cout << "Error: Malformed line in " << filename << ": " << line << endl;
+                return false;
+            }
+            shipmentRuns.push_back(entry);
+            continue;
+        }
+        if (loadingTerms) {
+            pair<uint32_t, ShipTerms> terms;
+            if (!parseTermsLine(line, 0, terms.first, terms.second)) {
+                cout << "Error: Malformed line in " << filename << ": " << line << endl;
+                return false;
+            }
+            termRuns.push_back(terms);
+            continue;
+        }
+        if (loadingLots) {
+            LotStore::Lot lot;
+            if (!parseLotLine(line, lot)) {
+                cout << "Error: Malformed line in " << filename << ": " << line << endl;
+                return false;
+            }
+            lotRuns.push_back(lot);
+            continue;
+        }
+        if (withQuantities && line.compare(0, 18, "--- Shipping Dock ") == 0) {
+            unsigned long dock = strtoul(line.c_str() + 18, nullptr, 10);
+            if (dock < 2 || dock > MAX_DOCKS) {
+                cout << "Error: Malformed line in " << filename << ": " << line << endl;
+                return false;
+            }
+            loadingInventory = false;
+            loadingShipping = true;
+            loadingLots = loadingPriority = loadingTerms = false;
+            loadingDock = dock - 1;
+            if (queueRuns.size() <= loadingDock) queueRuns.resize(loadingDock + 1);
+            continue;
+        }
+
+        if (!loadingInventory && !loadingShipping) continue;
+        if (line == "Inventory is empty." || line == "Shipping queue is empty.") continue;
+
+        pair<uint32_t, int> run(0, 1);
+        if (withQuantities) {
+            size_t tab = line.find('\t');
+            char* end = nullptr;
+            long qty = strtol(line.c_str(), &end, 10);
+            if (tab == string::npos || end != line.c_str() + tab || qty <= 0 || qty > numeric_limits<int>::max()) {
+                cout << "Error: Malformed line in " << filename << ": " << line << endl;
+                return false;
+            }
+            run = {folds.intern(line.substr(tab + 1)), static_cast<int>(qty)};
+        } else {
+            // Older saves hold one unit per line
+            run.first = folds.intern(line);
+        }
+        (loadingInventory ? stackRuns : queueRuns[loadingDock]).push_back(run);
+    }
+
+    infile.close();
+    // The file lists the stack top to bottom, so push it in reverse
+    for (auto it = stackRuns.rbegin(); it != stackRuns.rend(); ++it) {
+        inventory.push(it->first, it->second);
+    }
+    ensureDocks(queueRuns.size());
+    for (size_t d = 0; d < queueRuns.size(); d++) {
+        for (const auto& run : queueRuns[d]) {
+            docks[d].enqueue(run.first, run.second);
+        }
+    }
+    for (const LotStore::Lot& lot : lotRuns) {
+        lots.receive(lot.lotId, lot.itemId, lot.quantity, lot.received, lot.expiry);
+    }
+    if (priorityMode) switchShipping(true);
+    for (const PriorityShippingQueue::Entry& entry : shipmentRuns) {
+        priority.enqueue(entry.itemId, entry.quantity, entry.shipClass, entry.deadline);
+    }
+    for (const auto& terms : termRuns) {
+        applyTerms(terms.first, terms.second);
+    }
+    cout << "Previous data loaded from " << filename << endl;
+    folds.report(filename);
+    return true;
+}
+
+    // Rebuild both containers from a binary snapshot in one pass
+    void loadSnapshot(const char* base, size_t size, NameFolds& folds) {
+        SnapshotHeader header = SnapshotHeader();
+        if (size < SNAPSHOT_HEADER_SIZES[1]) {
+            throw runtime_error("Snapshot is truncated.");
+        }
+        memcpy(&header, base, SNAPSHOT_HEADER_SIZES[1]);
+        if (header.version < 1 || header.version > SNAPSHOT_VERSION || size < SNAPSHOT_HEADER_SIZES[header.version]) {
+            throw runtime_error("Unsupported snapshot version " + to_string(header.version) + ".");
+        }
+        // Fields a version lacks keep their zero defaults
+        size_t headerSize = SNAPSHOT_HEADER_SIZES[header.version];
+        memcpy(&header, base, headerSize);
+        if (header.version < 3) header.dockCount = 1;
+        if (header.dockCount == 0 || header.dockCount > MAX_DOCKS) {
+            throw runtime_error("Snapshot is truncated or corrupt.");
+        }
+
+        uint64_t countsSize = header.version < 3 ? 0 : header.dockCount * sizeof(uint64_t);
+        uint64_t offsetsSize = (uint64_t(header.nameCount) + 1) * sizeof(uint64_t);
+        uint64_t namesSize = (header.nameBytes + 7) & ~uint64_t(7);
+        uint64_t expected = headerSize + countsSize + offsetsSize + namesSize
+                          + (header.stackCount + header.queueCount) * sizeof(SnapshotRecord)
+                          + header.lotCount * sizeof(SnapshotLot) + header.priorityCount * sizeof(SnapshotShipment)
+                          + header.termsCount * sizeof(SnapshotTerms);
+        if (header.nameBytes > size || header.stackCount > size || header.queueCount > size
+                || header.lotCount > size || header.priorityCount > size || header.termsCount > size
+                || expected != size) {
+            throw runtime_error("Snapshot is truncated or corrupt.");
+        }
+
+        vector<uint64_t> dockCounts(header.dockCount, header.queueCount);
+        if (header.version >= 3) {
+            memcpy(dockCounts.data(), base + headerSize, countsSize);
+            uint64_t total = 0;
+            for (uint64_t count : dockCounts) {
+                if (count > header.queueCount) throw runtime_error("Snapshot is truncated or corrupt.");
+                total += count;
+            }
+            if (total != header.queueCount) throw runtime_error("Snapshot is truncated or corrupt.");
+        }
+
+        const char* offsets = base + headerSize + countsSize;
+        const char* names = offsets + offsetsSize;
+        const char* records = names + namesSize;
+
+        // Check the name table and every record before touching the
+        // containers, so a corrupt file leaves the warehouse as it was
+        for (uint32_t i = 0; i < header.nameCount; i++) {
+            uint64_t begin;
+            uint64_t end;
+            memcpy(&begin, offsets + i * sizeof(uint64_t), sizeof(begin));
+            memcpy(&end, offsets + (i + 1) * sizeof(uint64_t), sizeof(end));
+            if (begin > end || end > header.nameBytes) {
+                throw runtime_error("Snapshot name table is corrupt.");
+            }
+        }
+        const char* cursor = records;
+        for (uint64_t i = 0; i < header.stackCount + header.queueCount; i++) {
+            SnapshotRecord r;
+            memcpy(&r, cursor, sizeof(r));
+            cursor += sizeof(r);
+            if (r.nameId >= header.nameCount || r.quantity <= 0) {
+                throw runtime_error("Snapshot record is corrupt.");
+            }
+        }
+        for (uint64_t i = 0; i < header.lotCount; i++) {
+            SnapshotLot lot;
+            memcpy(&lot, cursor, sizeof(lot));
+            cursor += sizeof(lot);
+            if (lot.nameId >= header.nameCount || lot.quantity <= 0) {
+                throw runtime_error("Snapshot record is corrupt.");
+            }
+        }
+        for (uint64_t i = 0; i < header.priorityCount; i++) {
+            SnapshotShipment shipment;
+            memcpy(&shipment, cursor, sizeof(shipment));
+            cursor += sizeof(shipment);
+            if (shipment.nameId >= header.nameCount || shipment.quantity <= 0 || shipment.shipClass > SHIP_ECONOMY) {
+                throw runtime_error("Snapshot record is corrupt.");
+            }
+        }
+        for (uint64_t i = 0; i < header.termsCount; i++) {
+            SnapshotTerms terms;
+            memcpy(&terms, cursor, sizeof(terms));
+            cursor += sizeof(terms);
+            if (terms.nameId >= header.nameCount || terms.shipClass > SHIP_ECONOMY) {
+                throw runtime_error("Snapshot record is corrupt.");
+            }
+        }
+
+        // Map the snapshot's name table onto the live dictionary
+        vector<uint32_t> ids(header.nameCount);
+        for (uint32_t i = 0; i < header.nameCount; i++) {
+            uint64_t begin;
+            uint64_t end;
+            memcpy(&begin, offsets + i * sizeof(uint64_t), sizeof(begin));
+            memcpy(&end, offsets + (i + 1) * sizeof(uint64_t), sizeof(end));
+            ids[i] = folds.intern(string(names + begin, names + end));
+        }
+
+        // Stack records run top to bottom, so push them in reverse
+        for (uint64_t i = header.stackCount; i > 0; i--) {
+            SnapshotRecord r;
+            memcpy(&r, records + (i - 1) * sizeof(r), sizeof(r));
+            inventory.push(ids[r.nameId], r.quantity);
+        }
+        records += header.stackCount * sizeof(SnapshotRecord);
+        ensureDocks(header.dockCount);
+        for (size_t d = 0; d < header.dockCount; d++) {
+            for (uint64_t i = 0; i < dockCounts[d]; i++) {
+                SnapshotRecord r;
+                memcpy(&r, records, sizeof(r));
+                records += sizeof(r);
+                docks[d].enqueue(ids[r.nameId], r.quantity);
+            }
+        }
+        for (uint64_t i = 0; i < header.lotCount; i++) {
+            SnapshotLot lot;
+            memcpy(&lot, records, sizeof(lot));
+            records += sizeof(lot);
+            lots.receive(lot.lotId, ids[lot.nameId], lot.quantity, lot.received, lot.expiry);
+        }
+        if (header.priorityShipping != 0) switchShipping(true);
+        for (uint64_t i = 0; i < header.priorityCount; i++) {
+            SnapshotShipment shipment;
+            memcpy(&shipment, records, sizeof(shipment));
+            records += sizeof(shipment);
+            priority.enqueue(ids[shipment.nameId], shipment.quantity, static_cast<ShipClass>(shipment.shipClass),
+                             shipment.deadline);
+        }
+        for (uint64_t i = 0; i < header.termsCount; i++) {
+            SnapshotTerms terms;
+            memcpy(&terms, records, sizeof(terms));
+            records += sizeof(terms);
+            ShipTerms loaded;
+            loaded.shipClass = static_cast<ShipClass>(terms.shipClass);
+            loaded.deadline = min(terms.deadline, PriorityShippingQueue::NO_DEADLINE);
+            applyTerms(ids[terms.nameId], loaded);
+        }
+        snapshotGeneration = header.journalGeneration;
+        snapshotOffset = header.journalOffset;
+    }
+
+    // Add every valid row of a CSV/TSV receipts file to the inventory in
+    // file order. Chunks are parsed on up to `threads` workers (0: one per
+    // core) while the previous chunk is applied; a first line without a
+    // numeric quantity is taken as a header.
+    ImportStats importReceipts(const string& filename, unsigned threads = 0) {
+        ifstream infile(filename, ios::binary);
+        if (!infile) {
+            throw runtime_error("Could not open " + filename);
+        }
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+
+        ImportStats stats;
+        auto started = chrono::steady_clock::now();
+        vector<char> chunk;
+        vector<char> parsedChunk;  // keeps the rows of `parsing` alive
+        vector<future<ReceiptBlock>> parsing;
+        string carry;              // partial last line of the previous chunk
+        size_t lineBase = 0;
+        bool firstChunk = true;
+
+        while (true) {
+            chunk.assign(carry.begin(), carry.end());
+            size_t have = chunk.size();
+            chunk.resize(have + IMPORT_CHUNK_BYTES);
+            infile.read(chunk.data() + have, IMPORT_CHUNK_BYTES);
+            size_t got = static_cast<size_t>(infile.gcount());
+            stats.bytes += got;
+            chunk.resize(have + got);
+            bool last = got < IMPORT_CHUNK_BYTES;
+
+            size_t end = chunk.size();
+            carry.clear();
+            if (!last) {
+                size_t cut = end;
+                while (cut > 0 && chunk[cut - 1] != '\n') cut--;
+                carry.assign(chunk.begin() + cut, chunk.end());
+                end = cut;
+            }
+
+            char* base = chunk.data();
+            size_t start = 0;
+            if (firstChunk && end > 0) {
+                const char* eol = static_cast<const char*>(memchr(base, '\n', end));
+                size_t lineEnd = eol == nullptr ? end : eol - base;
+                size_t trimmed = lineEnd > 0 && base[lineEnd - 1] == '\r' ? lineEnd - 1 : lineEnd;
+                size_t sep = trimmed;
+                while (sep > 0 && base[sep - 1] != ',' && base[sep - 1] != '\t') sep--;
+                int qty;
+                if (sep > 0 && !parseQuantity(base + sep, base + trimmed, qty)) {
+                    start = eol == nullptr ? end : lineEnd + 1;
+                    lineBase = 1;
+                }
+                firstChunk = false;
+            }
+
+            // Line-aligned blocks, one per worker
+            vector<future<ReceiptBlock>> blocks;
+            size_t blockSize = (end - start) / threads + 1;
+            while (start < end) {
+                size_t stop = min(end, start + blockSize);
+                while (stop < end && base[stop - 1] != '\n') stop++;
+                blocks.push_back(async(launch::async, parseReceiptBlock, base + start, base + stop, journal.isOpen()));
+                start = stop;
+            }
+
+            applyReceipts(parsing, lineBase, stats);
+            parsing = move(blocks);
+            swap(parsedChunk, chunk);
+            if (last) break;
+        }
+        applyReceipts(parsing, lineBase, stats);
+
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return stats;
+    }
+
+    void addItem(string itemName,int qty) {
+        inventory.push(skuDictionary().intern(itemName),qty);
+        journal.record("A " + to_string(qty) + " " + itemName);
+         cout << "Item \"" << itemName << "\" added to inventory. Quantity: " << qty << endl;
+    }
+
+    // Add stock that is to ship on the given terms
+    void addItem(const string& itemName, int qty, const ShipTerms& terms) {
+        setShipTerms(itemName, terms);
+        addItem(itemName, qty);
+    }
+
+    // Class and ship-by day the item's units are queued with when they are
+    // processed under priority shipping; units already queued keep theirs
+    void setShipTerms(const string& itemName, const ShipTerms& terms) {
+        uint32_t itemId = skuDictionary().intern(itemName);
+        if (termsOf(itemId) == terms) return;
+        applyTerms(itemId, terms);
+        journal.record("T " + to_string(terms.shipClass) + " " + to_string(terms.deadline) + " " + itemName);
+        cout << "Item \"" << itemName << "\" ships " << describeTerms(terms.shipClass, terms.deadline) << "." << endl;
+    }
+
+    // Ship through the priority queue (express, then standard, then economy;
+    // earliest ship-by date first within a class) instead of the FIFO docks.
+    // Every dock then ships from the one priority queue.
+    void usePriorityShipping(bool on) {
+        if (on == priorityShipping) return;
+        switchShipping(on);
+        journal.record(on ? "B 1" : "B 0");
+        cout << "Shipping is now " << (on ? "by priority." : "first in, first out.") << endl;
+    }
+
+    bool isPriorityShipping() const { return priorityShipping; }
+
+    // Receive qty units of an item as a lot expiring on the given day
+    void receiveLot(const string& itemName, int qty, uint64_t lotId, int32_t expiry) {
+        int32_t received = today();
+        if (!lots.receive(lotId, skuDictionary().intern(itemName), qty, received, expiry)) {
+            cout << "Lot " << lotId << " is already in use for another item or expiry date." << endl;
+            return;
+        }
+        journal.record("L " + to_string(qty) + " " + to_string(lotId) + " " + to_string(received) + " "
+                       + to_string(expiry) + " " + itemName);
+        cout << "Lot " << lotId << " of \"" << itemName << "\" received. Quantity: " << qty
+             << ", expires " << formatDate(expiry) << endl;
+    }
+
+    // Move up to qty units of an item to shipping, earliest-expiring lots first
+    void processLot(const string& itemName, int qty) {
+        try {
+            uint32_t itemId = skuDictionary().lookup(itemName);
+            size_t dock = priorityShipping ? 0 : routeDock(itemId);
+            vector<pair<uint64_t, int>> from;
+            int moved = moveLotUnits(itemId, qty, dock, &from);
+            if (moved == 0) {
+                cout << "No lots of \"" << itemName << "\" in stock." << endl;
+                return;
+            }
+            journal.record("F " + to_string(moved) + " " + to_string(dock) + " " + itemName);
+            cout << "Processed " << moved << " unit(s) of \"" << itemName << "\" from lot(s)";
+            for (const auto& part : from) {
+                cout << " " << part.first << " (" << part.second << ")";
+            }
+            cout << " and added to shipping queue";
+            ShipTerms terms = termsOf(itemId);
+            if (priorityShipping) cout << " (" << describeTerms(terms.shipClass, terms.deadline) << ")";
+            else if (docks.size() > 1) cout << " at dock " << dock + 1;
+            cout << "." << endl;
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    // Drop every lot that expires before the given day
+    void expireLots(int32_t before) {
+        size_t dropped;
+        long long units = lots.expireBefore(before, dropped);
+        if (dropped > 0) journal.record("X " + to_string(before));
+        cout << "Expired " << dropped << " lot(s), " << units << " unit(s), dated before "
+             << formatDate(before) << "." << endl;
+    }
+
+    void processItem() {
+         try {
+            uint32_t itemId = inventory.pop();
+            if (priorityShipping) {
+                queueForShipping(itemId, 1, 0);
+                journal.record("P 1");
+                ShipTerms terms = termsOf(itemId);
+                cout << "Processed \"" << skuDictionary().name(itemId) << "\" and added to shipping queue ("
+                     << describeTerms(terms.shipClass, terms.deadline) << ")." << endl;
+                return;
+            }
+            size_t dock = routeDock(itemId);
+            docks[dock].enqueue(itemId);
+            if (docks.size() == 1) {
+                journal.record("P 1");
+                cout << "Processed \"" << skuDictionary().name(itemId) << "\" and added to shipping queue." << endl;
+            } else {
+                journal.record("P 1 " + to_string(dock));
+                cout << "Processed \"" << skuDictionary().name(itemId) << "\" and added to shipping queue at dock "
+                     << dock + 1 << "." << endl;
+            }
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    // Process up to n units from the top of the inventory in one call.
+    // Whole entries are moved at once, so the cost is per entry, not per unit.
+    void processN(long long n) {
+        if (inventory.isEmpty()) {
+            cout << "No items in inventory to process!" << endl;
+            return;
+        }
+        string records;
+        long long moved = processUnits(n, NO_DOCK, &records);
+        if (docks.size() == 1 || priorityShipping) {
+            journal.record("P " + to_string(moved));
+        } else {
+            journal.recordBatch(records);
+        }
+        cout << "Processed " << moved << " item(s) and added to shipping queue." << endl;
+    }
+
+    void processAll() {
+        processN(numeric_limits<long long>::max());
+    }
+
+    // Ship one unit from a dock, refilling it from another dock if it is empty
+    void shipItem(size_t dock = 0) {
+        try {
+            uint32_t itemId;
+            if (priorityShipping) {
+                itemId = priority.dequeue();
+            } else {
+                if (docks[dock].isEmpty()) stealInto(dock);
+                itemId = docks[dock].dequeue();
+            }
+            dockStats[dock].shipped++;
+            journal.record(dock == 0 ? "S 1" : "S 1 " + to_string(dock));
+            cout << "Shipping item: " << skuDictionary().name(itemId) << endl;
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    // Ship up to n units from the front of a dock's queue in one call and
+    // return them as (item, quantity) runs. Whole entries are taken at once;
+    // a dock that runs dry steals from the others. Under priority shipping
+    // the units come off the priority queue.
+    vector<ManifestLine> shipBatch(long long n, size_t dock = 0) {
+        vector<ManifestLine> manifest;
+        long long requested = n;
+        ShippingQueue& shipping = docks[dock];
+        while (n > 0) {
+            uint32_t itemId;
+            int qty;
+            if (priorityShipping) {
+                qty = priority.dequeueUpTo(static_cast<int>(min<long long>(n, numeric_limits<int>::max())), itemId);
+                if (qty == 0) break;
+            } else {
+                if (shipping.isEmpty() && !stealInto(dock)) break;
+                itemId = shipping.peek();
+                qty = shipping.quantityOf(itemId);
+                if (qty > n) qty = static_cast<int>(n);
+                shipping.take(itemId, qty);
+            }
+            n -= qty;
+
+            if (!manifest.empty() && manifest.back().itemId == itemId) {
+                manifest.back().quantity += qty;
+            } else {
+                manifest.push_back({itemId, qty});
+            }
+        }
+        if (requested > n) {
+            dockStats[dock].shipped += requested - n;
+            journal.record("S " + to_string(requested - n) + (dock == 0 ? "" : " " + to_string(dock)));
+        }
+        return manifest;
+    }
+
+    // Write a manifest as "item,quantity" lines with a single buffered write
+    void saveManifest(const vector<ManifestLine>& manifest, const string& filename) const {
+        string buffer = "item,quantity\n";
+        for (const ManifestLine& line : manifest) {
+            buffer += skuDictionary().name(line.itemId);
+            buffer += ',';
+            buffer += to_string(line.quantity);
+            buffer += '\n';
+        }
+
+        ofstream outfile(filename, ios::binary);
+        if (!outfile) {
+            cout << "Error: Could not open file for writing!" << endl;
+            return;
+        }
+        outfile.write(buffer.data(), buffer.size());
+        outfile.close();
+        cout << "Manifest saved to " << filename << endl;
+    }
+
+    void viewLastIncoming() const {
+         try {
+            cout << "Last incoming item: " << skuDictionary().name(inventory.peek()) << endl;
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
+    }
+
+    void viewNextShipment() const {
+        if (priorityShipping) {
+            try {
+                uint32_t itemId = priority.peek();
+                cout << "Next item to ship: " << skuDictionary().name(itemId) << " ("
+                     << describeTerms(priority.peekClass(), priority.peekDeadline()) << ")" << endl;
+            } catch (const runtime_error& e) {
+                cout << e.what() << endl;
+            }
+            return;
+        }
+        for (size_t d = 0; d < docks.size(); d++) {
+            try {
+                if (docks.size() > 1) cout << "Dock " << d + 1 << ": ";
+                cout << "Next item to ship: " << skuDictionary().name(docks[d].peek()) << endl;
+            } catch (const runtime_error& e) {
+                cout << e.what() << endl;
+            }
+        }
+    }
+
+    void viewAll() const {
+    cout << "\n--- Current Inventory ---" << endl;
+    inventory.displayAll();
+    if (!lots.isEmpty()) {
+        cout << "--- Lots (earliest expiry first) ---" << endl;
+        for (const auto& entry : lots) {
+            const LotStore::Lot& lot = entry.second;
+            cout << skuDictionary().name(lot.itemId) << " lot " << lot.lotId << " (" << lot.quantity
+                 << "), expires " << formatDate(lot.expiry) << endl;
+        }
+    }
+    if (priorityShipping) {
+        cout << "--- Current Shipping Queue (priority order) ---" << endl;
+        if (priority.isEmpty()) {
+            cout << "Shipping queue is empty." << endl;
+            return;
+        }
+        cout << "Shipping queue items (next first): ";
+        for (const PriorityShippingQueue::Entry& entry : priority.entries()) {
+            cout << skuDictionary().name(entry.itemId) << "(" << entry.quantity << ", "
+                 << describeTerms(entry.shipClass, entry.deadline) << ") ";
+        }
+        cout << endl;
+        return;
+    }
+    for (size_t d = 0; d < docks.size(); d++) {
+        if (docks.size() == 1) {
+            cout << "--- Current Shipping Queue ---" << endl;
+        } else {
+            cout << "--- Current Shipping Queue (dock " << d + 1 << ") ---" << endl;
+        }
+        docks[d].displayAll();
+    }
+}
+
+// Depth, units shipped and stolen, and ship rate of each dock
+void viewDockStatus() const {
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - dockStatsSince).count(), 1e-9);
+    cout << "\n--- Dock Status (" << dockPolicyName(dockPolicy) << " routing, " << seconds << " s) ---" << endl;
+    if (priorityShipping) {
+        cout << "Priority queue, shared by all docks: " << priority.unitCount() << " unit(s) in "
+             << priority.entryCount() << " entr" << (priority.entryCount() == 1 ? "y" : "ies") << endl;
+    }
+    for (size_t d = 0; d < docks.size(); d++) {
+        cout << "Dock " << d + 1 << ": " << docks[d].unitCount() << " unit(s) in " << docks[d].entryCount()
+             << " entr" << (docks[d].entryCount() == 1 ? "y" : "ies") << " queued, "
+             << dockStats[d].shipped << " shipped (" << dockStats[d].shipped / seconds << "/s), "
+             << dockStats[d].stolen << " stolen" << endl;
+    }
+}
+
+// Search for an item in Inventory Stack and Shipping Queue
+void searchItem(const string& name) const {
+    try {
+        uint32_t id = skuDictionary().lookup(name);
+
+         // Search in Inventory (stack)
+        int stocked = inventory.quantityOf(id);
+        if (stocked > 0) {
+            cout << "Found in Inventory: " << name
+                 << " (" << stocked << ")" << endl;
+            return;// Stop once found
+        }
+
+        // Search in lots
+        long long inLots = lots.unitsOf(id);
+        if (inLots > 0) {
+            cout << "Found in Lots: " << name << " (" << inLots << ")" << endl;
+            return;
+        }
+
+        // Search in Shipping Queue
+        size_t dock = dockHolding(id);
+        if (dock != NO_DOCK) {
+            cout << "Found in Shipping Queue: " << name
+                 << " (" << docks[dock].quantityOf(id) << ")";
+            if (docks.size() > 1) cout << " at dock " << dock + 1;
+            cout << endl;
+            return;// Stop once found
+        }
+        int queued = priority.quantityOf(id);
+        if (queued > 0) {
+            cout << "Found in Shipping Queue: " << name << " (" << queued << ")" << endl;
+            return;
+        }
+
+        // If not found in both structures, throw error
+        throw runtime_error("Item not found: " + name);
+
+    } catch (const runtime_error& e) {
+
+        // Handle the error message here
+        cout << e.what() << endl;
+    }
+}
+
+// Remove an item by name (from Inventory, Lots or Shipping Queue)
+void removeItem(const string& name) {
+    try {
+        uint32_t id = skuDictionary().lookup(name);
+
+        // Search in Inventory (stack)
+        if (inventory.quantityOf(id) > 0) {
+
+            // Takes one unit, removing the entry once it runs out
+            inventory.take(id, 1);
+            journal.record("R " + name);
+            cout << "Removed \"" << name << "\" from Inventory." << endl;
+            return;
+        }
+
+        // Search in lots, taking from the one that expires first
+        if (lots.takeEarliest(id, 1) > 0) {
+            journal.record("R " + name);
+            cout << "Removed \"" << name << "\" from Lots." << endl;
+            return;
+        }
+
+        // Search in Shipping Queue
+        size_t dock = dockHolding(id);
+        if (dock != NO_DOCK) {
+
+            // Takes one unit, removing the entry once it runs out
+            docks[dock].take(id, 1);
+            journal.record("R " + name);
+            cout << "Removed \"" << name << "\" from Shipping Queue." << endl;
+            return;
+        }
+        if (priority.quantityOf(id) > 0) {
+            priority.take(id, 1);
+            journal.record("R " + name);
+            cout << "Removed \"" << name << "\" from Shipping Queue." << endl;
+            return;
+        }
+
+        throw runtime_error("Item not found: " + name);
+
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+// Count total items (Inventory + Shipping Queue)
+void countItems() const {
+#ifdef WAREHOUSE_DEBUG
+    verifyCounts();
+#endif
+    long long count = inventory.unitCount() + lots.unitCount() + shippingUnits();
+    cout << "Total items in system: " << count << endl;
+}
+
+// Cross-check the running totals of both containers against a full scan
+void verifyCounts() const {
+    long long units = 0;
+    size_t entries = 0;
+    for (const auto& entry : inventory) {
+        units += entry.quantity;
+        entries++;
+    }
+    if (units != inventory.unitCount() || entries != inventory.entryCount()) {
+        throw logic_error("Inventory counters out of sync with its contents");
+    }
+
+    for (const ShippingQueue& dock : docks) {
+        units = 0;
+        entries = 0;
+        for (const auto& entry : dock) {
+            units += entry.quantity;
+            entries++;
+        }
+        if (units != dock.unitCount() || entries != dock.entryCount()) {
+            throw logic_error("Shipping queue counters out of sync with its contents");
+        }
+    }
+
+    units = 0;
+    vector<PriorityShippingQueue::Entry> queued = priority.entries();
+    for (const PriorityShippingQueue::Entry& entry : queued) {
+        units += entry.quantity;
+    }
+    if (units != priority.unitCount() || (!priorityShipping && !queued.empty())) {
+        throw logic_error("Priority queue counters out of sync with its contents");
+    }
+}
+
+void saveToFile(const string& filename) const {
+    try {
+        writeTextFile(filename);
+        cout << "Final result saved to " << filename << endl;
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+// Write both containers as a binary snapshot (see SnapshotHeader)
+void saveSnapshot(const string& filename) {
+    try {
+        journal.flush();
+        writeSnapshotFile(filename);
+        cout << "Snapshot saved to " << filename << endl;
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+// Open the journal, first replaying whatever it holds beyond the loaded
+// snapshot. A journal that does not continue from that snapshot is
+// discarded and a new generation is started.
+void openJournal(const string& filename, const JournalPolicy& policy = JournalPolicy()) {
+    ifstream infile(filename, ios::binary);
+    string header;
+    uint64_t generation = 0;
+    bool usable = false;
+    if (infile && getline(infile, header) && header.compare(0, 10, "WHJOURNAL ") == 0) {
+        generation = strtoull(header.c_str() + 10, nullptr, 10);
+        if (generation == snapshotGeneration) {
+            // Same generation: the snapshot already holds the first part
+            infile.seekg(static_cast<streamoff>(snapshotOffset));
+            usable = true;
+        } else if (generation == snapshotGeneration + 1) {
+            usable = true;
+        }
+    }
+
+    try {
+        if (usable) {
+            uint64_t validEnd = 0;
+            NameFolds folds;
+            size_t replayed = replayJournal(infile, validEnd, folds);
+            if (replayed > 0) {
+                cout << "Replayed " << replayed << " journaled operation(s) from " << filename << endl;
+            }
+            folds.report(filename);
+            infile.close();
+            // Drop a record torn by a crash so new records start on a clean line
+            if (validEnd != 0 && validEnd < filesystem::file_size(filename)) {
+                filesystem::resize_file(filename, validEnd);
+            }
+            journal.open(filename, generation, policy);
+        } else {
+            infile.close();
+            error_code ec;
+            bool stale = filesystem::file_size(filename, ec) > 0 && !ec;
+            if (stale) {
+                cout << "Journal " << filename << " does not match the loaded data; starting a new one." << endl;
+            }
+            journal.open(filename, snapshotGeneration + 1, policy);
+            if (stale) journal.restart(snapshotGeneration + 1);
+        }
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+// Re-apply journaled operations without printing. validEnd is set to the
+// offset just past the last complete record.
+size_t replayJournal(istream& in, uint64_t& validEnd, NameFolds& folds) {
+    size_t applied = 0;
+    string line;
+    streamoff start = in.tellg();
+    validEnd = start < 0 ? 0 : static_cast<uint64_t>(start);
+    while (getline(in, line)) {
+        if (in.eof()) break;  // no newline: torn by a crash mid-write
+        validEnd = static_cast<uint64_t>(in.tellg());
+        if (line.size() < 3 || line[1] != ' ') continue;
+
+        string rest = line.substr(2);
+        size_t space = rest.find(' ');
+        long long n = strtoll(rest.c_str(), nullptr, 10);
+        string name = space == string::npos ? "" : rest.substr(space + 1);
+        switch (line[0]) {
+            case 'A':
+                inventory.push(folds.intern(name), static_cast<int>(n));
+                break;
+            case 'P':
+            case 'S': {
+                // An optional dock follows the count; older records mean dock 0
+                unsigned long dock = strtoul(name.c_str(), nullptr, 10);
+                if (dock >= MAX_DOCKS) continue;
+                ensureDocks(dock + 1);
+                if (line[0] == 'P') processUnits(n, dock);
+                else shipBatch(n, dock);
+                break;
+            }
+            case 'R':
+                removeOne(skuDictionary().lookup(canonicalItemName(rest)));
+                break;
+            case 'L': {
+                // L qty lot received expiry name
+                char* cursor = nullptr;
+                uint64_t lotId = strtoull(name.c_str(), &cursor, 10);
+                long received = strtol(cursor, &cursor, 10);
+                long expiry = strtol(cursor, &cursor, 10);
+                if (*cursor != ' ') continue;
+                lots.receive(lotId, folds.intern(cursor + 1), static_cast<int>(n),
+                             static_cast<int32_t>(received), static_cast<int32_t>(expiry));
+                break;
+            }
+            case 'F': {
+                // F qty dock name
+                char* cursor = nullptr;
+                unsigned long dock = strtoul(name.c_str(), &cursor, 10);
+                if (*cursor != ' ' || dock >= MAX_DOCKS) continue;
+                ensureDocks(dock + 1);
+                moveLotUnits(skuDictionary().lookup(canonicalItemName(cursor + 1)), static_cast<int>(n), dock);
+                break;
+            }
+            case 'X': {
+                size_t dropped;
+                lots.expireBefore(static_cast<int32_t>(n), dropped);
+                break;
+            }
+            case 'T': {
+                // T class deadline name
+                char* cursor = nullptr;
+                unsigned long deadline = strtoul(name.c_str(), &cursor, 10);
+                if (*cursor != ' ' || n < SHIP_EXPRESS || n > SHIP_ECONOMY) continue;
+                ShipTerms terms;
+                terms.shipClass = static_cast<ShipClass>(n);
+                terms.deadline = static_cast<uint32_t>(min<unsigned long>(deadline,
+                                                                         PriorityShippingQueue::NO_DEADLINE));
+                applyTerms(folds.intern(cursor + 1), terms);
+                break;
+            }
+            case 'B':
+                switchShipping(n != 0);
+                break;
+            default:
+                continue;
+        }
+        applied++;
+    }
+    return applied;
+}
+
+// Load a snapshotImage taken from another warehouse, such as the one the
+// checkpoint writer restores its replica from
+void restoreImage(const string& image) {
+    NameFolds folds;
+    loadSnapshot(image.data(), image.size(), folds);
+}
+
+// Replay journal records into this warehouse and write both checkpoint
+// files from the result, stamped with the journal position it reaches
+void writeCheckpoint(const string& records, uint64_t generation, uint64_t offset,
+                     const string& textFile, const string& snapshotFile) {
+    istringstream in(records);
+    uint64_t validEnd = 0;
+    NameFolds folds;
+    replayJournal(in, validEnd, folds);
+    snapshotGeneration = generation;
+    snapshotOffset = offset;
+    writeTextFile(textFile);
+    writeSnapshotFile(snapshotFile);
+}
+
+// Start a fresh journal; call right after saveSnapshot, which covers
+// everything logged so far
+void resetJournal() {
+    if (!journal.isOpen()) return;
+    try {
+        journal.restart(journal.generation() + 1);
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+};
+
+// Test-and-test-and-set lock for critical sections of a few instructions.
+// Waiters spin briefly and then yield, since threads may outnumber cores.
+class SpinLock {
+private:
+    atomic<bool> locked{false};
+
+public:
+    void lock() {
+        int spins = 0;
+        while (locked.exchange(true, memory_order_acquire)) {
+            while (locked.load(memory_order_relaxed)) {
+                if (++spins < 64) {
+#ifdef WAREHOUSE_NAME_SSE2
+                    _mm_pause();
+#endif
+                } else {
+                    this_thread::yield();
+                }
+            }
+        }
+    }
+
+    void unlock() {
+        locked.store(false, memory_order_release);
+    }
+};
+
+// A lock plus a sequence number for optimistic readers. Writers make the
+// version odd while they change the guarded state; a reader that sees the
+// same even version before and after its reads saw a consistent state.
+struct alignas(64) SeqGuard {
+    SpinLock lock;
+    atomic<uint64_t> version{0};
+};
+
+class SeqWrite {
+private:
+    SeqGuard& guard;
+
+public:
+    explicit SeqWrite(SeqGuard& guard) : guard(guard) {
+        guard.lock.lock();
+        guard.version.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    ~SeqWrite() {
+        guard.version.fetch_add(1, memory_order_release);
+        guard.lock.unlock();
+    }
+
+    SeqWrite(const SeqWrite&) = delete;
+    SeqWrite& operator=(const SeqWrite&) = delete;
+};
+
+// Thread-safe counterpart of WarehouseSystem for the top/front commands.
+// Names are interned in shards picked by hash, each with its own lock on
+// its own cache line, and each name keeps its inventory and shipping
+// totals there. The stack top, the queue rear and the queue front each
+// have their own lock; processing takes the top and then the rear lock,
+// growing the queue also takes the front lock, always in that order.
+// countItems, searchItem and viewAll read optimistically against the
+// versions of those locks and retry on a change, so they never hold up
+// writers unless they keep losing the race.
+class ConcurrentWarehouse {
+private:
+    struct Shard;
+
+    struct NameState {
+        string name;
+        Shard* shard;
+        atomic<long long> inventory{0};  // written under the shard's guard
+        atomic<long long> shipping{0};
+
+        NameState(const string& name, Shard* shard) : name(name), shard(shard) {}
+    };
+
+    struct alignas(64) Shard {
+        SeqGuard guard;
+        SkuDictionary names;
+        vector<unique_ptr<NameState>> states;  // by id in names
+    };
+
+    struct Slot {
+        atomic<NameState*> item{nullptr};
+        atomic<int> quantity{0};
+    };
+
+    // Slots and their count allocated together, so a reader never pairs a
+    // buffer with another buffer's capacity
+    struct SlotBuffer {
+        size_t capacity;
+        unique_ptr<Slot[]> slots;
+
+        explicit SlotBuffer(size_t capacity) : capacity(capacity), slots(new Slot[capacity]) {}
+    };
+
+    static constexpr size_t INITIAL_SLOTS = 1024;
+    static constexpr int OPTIMISTIC_TRIES = 16;
+
+    size_t shardMask;
+    unique_ptr<Shard[]> shards;
+
+    SeqGuard top;
+    atomic<SlotBuffer*> stackSlots;
+    atomic<size_t> stackSize{0};
+    atomic<long long> stackUnits{0};
+    vector<unique_ptr<SlotBuffer>> stackBuffers;  // current one last; older ones stay for readers
+
+    SeqGuard rear;
+    SeqGuard front;
+    atomic<SlotBuffer*> queueSlots;  // ring indexed by absolute position
+    atomic<uint64_t> queueHead{0};
+    atomic<uint64_t> queueTail{0};
+    atomic<long long> queueUnits{0};
+    vector<unique_ptr<SlotBuffer>> queueBuffers;
+
+    Shard& shardFor(const string& name) const {
+        return shards[hash<string>()(name) & shardMask];
+    }
+
+    NameState* intern(const string& name) {
+        Shard& shard = shardFor(name);
+        lock_guard<SpinLock> hold(shard.guard.lock);
+        uint32_t id = shard.names.intern(name);
+        if (id == shard.states.size()) {
+            shard.states.emplace_back(new NameState(name, &shard));
+        }
+        return shard.states[id].get();
+    }
+
+    NameState* find(const string& name) const {
+        Shard& shard = shardFor(name);
+        lock_guard<SpinLock> hold(shard.guard.lock);
+        uint32_t id = shard.names.lookup(name);
+        return id == SkuDictionary::NO_ID ? nullptr : shard.states[id].get();
+    }
+
+    static void adjust(NameState* item, long long inventory, long long shipping) {
+        SeqWrite write(item->shard->guard);
+        item->inventory.store(item->inventory.load(memory_order_relaxed) + inventory, memory_order_relaxed);
+        item->shipping.store(item->shipping.load(memory_order_relaxed) + shipping, memory_order_relaxed);
+    }
+
+    static SlotBuffer* grow(vector<unique_ptr<SlotBuffer>>& buffers, const SlotBuffer* old,
+                            uint64_t from, uint64_t to) {
+        buffers.emplace_back(new SlotBuffer(old->capacity * 2));
+        SlotBuffer* grown = buffers.back().get();
+        for (uint64_t pos = from; pos < to; pos++) {
+            const Slot& src = old->slots[pos & (old->capacity - 1)];
+            Slot& dst = grown->slots[pos & (grown->capacity - 1)];
+            dst.item.store(src.item.load(memory_order_relaxed), memory_order_relaxed);
+            dst.quantity.store(src.quantity.load(memory_order_relaxed), memory_order_relaxed);
+        }
+        return grown;
+    }
+
+    // Rear lock held
+    void enqueueLocked(NameState* item, int qty) {
+        SlotBuffer* ring = queueSlots.load(memory_order_relaxed);
+        uint64_t tail = queueTail.load(memory_order_relaxed);
+        if (tail - queueHead.load(memory_order_acquire) == ring->capacity) {
+            SeqWrite holdFront(front);
+            ring = grow(queueBuffers, ring, queueHead.load(memory_order_relaxed), tail);
+            queueSlots.store(ring, memory_order_release);
+        }
+        Slot& slot = ring->slots[tail & (ring->capacity - 1)];
+        slot.item.store(item, memory_order_relaxed);
+        slot.quantity.store(qty, memory_order_relaxed);
+        queueTail.store(tail + 1, memory_order_release);
+        queueUnits.fetch_add(qty, memory_order_relaxed);
+    }
+
+    // Retry an optimistic read of the stack and queue against the three
+    // end locks; after OPTIMISTIC_TRIES losses, take the locks instead
+    template <typename Read>
+    void readEnds(Read read) const {
+        SeqGuard& t = const_cast<SeqGuard&>(top);
+        SeqGuard& r = const_cast<SeqGuard&>(rear);
+        SeqGuard& f = const_cast<SeqGuard&>(front);
+        for (int attempt = 0; attempt < OPTIMISTIC_TRIES; attempt++) {
+            uint64_t vt = t.version.load(memory_order_acquire);
+            uint64_t vr = r.version.load(memory_order_acquire);
+            uint64_t vf = f.version.load(memory_order_acquire);
+            if ((vt | vr | vf) & 1) {
+                this_thread::yield();
+                continue;
+            }
+            read();
+            atomic_thread_fence(memory_order_acquire);
+            if (t.version.load(memory_order_relaxed) == vt && r.version.load(memory_order_relaxed) == vr
+                    && f.version.load(memory_order_relaxed) == vf) {
+                return;
+            }
+        }
+        lock_guard<SpinLock> holdTop(t.lock);
+        lock_guard<SpinLock> holdRear(r.lock);
+        lock_guard<SpinLock> holdFront(f.lock);
+        read();
+    }
+
+    static void printRuns(const vector<pair<const NameState*, long long>>& runs) {
+        for (const auto& run : runs) {
+            cout << run.first->name << "(" << run.second << ") ";
+        }
+        cout << endl;
+    }
+
+    // Append a slot to a display list, merging it with an equal neighbour
+    static void addRun(vector<pair<const NameState*, long long>>& runs, const Slot& slot) {
+        const NameState* item = slot.item.load(memory_order_relaxed);
+        int qty = slot.quantity.load(memory_order_relaxed);
+        if (item == nullptr || qty <= 0) return;
+        if (!runs.empty() && runs.back().first == item) {
+            runs.back().second += qty;
+        } else {
+            runs.push_back({item, qty});
+        }
+    }
+
+public:
+    // shardCount is rounded up to a power of two
+    explicit ConcurrentWarehouse(size_t shardCount = 64) {
+        size_t count = 1;
+        while (count < shardCount) count *= 2;
+        shardMask = count - 1;
+        shards.reset(new Shard[count]);
+        stackBuffers.emplace_back(new SlotBuffer(INITIAL_SLOTS));
+        stackSlots.store(stackBuffers.back().get());
+        queueBuffers.emplace_back(new SlotBuffer(INITIAL_SLOTS));
+        queueSlots.store(queueBuffers.back().get());
+    }
+
+    ConcurrentWarehouse(const ConcurrentWarehouse&) = delete;
+    ConcurrentWarehouse& operator=(const ConcurrentWarehouse&) = delete;
+
+    // The mutators are quiet and report through their return values, so
+    // many threads can drive them without serializing on cout
+
+    void addItem(const string& name, int qty) {
+        NameState* item = intern(name);
+        {
+            SeqWrite write(top);
+            SlotBuffer* slots = stackSlots.load(memory_order_relaxed);
+            size_t size = stackSize.load(memory_order_relaxed);
+            if (size > 0 && slots->slots[size - 1].item.load(memory_order_relaxed) == item) {
+                Slot& slot = slots->slots[size - 1];
+                slot.quantity.store(slot.quantity.load(memory_order_relaxed) + qty, memory_order_relaxed);
+            } else {
+                if (size == slots->capacity) {
+                    slots = grow(stackBuffers, slots, 0, size);
+                    stackSlots.store(slots, memory_order_release);
+                }
+                slots->slots[size].item.store(item, memory_order_relaxed);
+                slots->slots[size].quantity.store(qty, memory_order_relaxed);
+                stackSize.store(size + 1, memory_order_release);
+            }
+            stackUnits.fetch_add(qty, memory_order_relaxed);
+        }
+        adjust(item, qty, 0);
+    }
+
+    // Move one unit from the top of the stack to the rear of the queue
+    bool processItem() {
+        NameState* item;
+        {
+            SeqWrite holdTop(top);
+            size_t size = stackSize.load(memory_order_relaxed);
+            if (size == 0) return false;
+            Slot& slot = stackSlots.load(memory_order_relaxed)->slots[size - 1];
+            item = slot.item.load(memory_order_relaxed);
+            int qty = slot.quantity.load(memory_order_relaxed);
+            if (qty == 1) {
+                stackSize.store(size - 1, memory_order_release);
+            } else {
+                slot.quantity.store(qty - 1, memory_order_relaxed);
+            }
+            stackUnits.fetch_sub(1, memory_order_relaxed);
+
+            SeqWrite holdRear(rear);
+            enqueueLocked(item, 1);
+        }
+        adjust(item, -1, 1);
+        return true;
+    }
+
+    // Ship one unit from the front of the queue
+    bool shipItem() {
+        NameState* item;
+        {
+            SeqWrite holdFront(front);
+            uint64_t head = queueHead.load(memory_order_relaxed);
+            if (head == queueTail.load(memory_order_acquire)) return false;
+            SlotBuffer* ring = queueSlots.load(memory_order_relaxed);
+            Slot& slot = ring->slots[head & (ring->capacity - 1)];
+            item = slot.item.load(memory_order_relaxed);
+            int qty = slot.quantity.load(memory_order_relaxed);
+            if (qty == 1) {
+                queueHead.store(head + 1, memory_order_release);
+            } else {
+                slot.quantity.store(qty - 1, memory_order_relaxed);
+            }
+            queueUnits.fetch_sub(1, memory_order_relaxed);
+        }
+        adjust(item, 0, -1);
+        return true;
+    }
+
+    // Units in both containers, read as of one instant
+    long long totalUnits() const {
+        long long units = 0;
+        readEnds([&] {
+            units = stackUnits.load(memory_order_relaxed) + queueUnits.load(memory_order_relaxed);
+        });
+        return units;
+    }
+
+    void countItems() const {
+        cout << "Total items in system: " << totalUnits() << endl;
+    }
+
+    void searchItem(const string& name) const {
+        NameState* item = find(name);
+        long long inventory = 0;
+        long long shipping = 0;
+        if (item != nullptr) {
+            SeqGuard& guard = item->shard->guard;
+            bool consistent = false;
+            for (int attempt = 0; attempt < OPTIMISTIC_TRIES && !consistent; attempt++) {
+                uint64_t version = guard.version.load(memory_order_acquire);
+                if (version & 1) {
+                    this_thread::yield();
+                    continue;
+                }
+                inventory = item->inventory.load(memory_order_relaxed);
+                shipping = item->shipping.load(memory_order_relaxed);
+                atomic_thread_fence(memory_order_acquire);
+                consistent = guard.version.load(memory_order_relaxed) == version;
+            }
+            if (!consistent) {
+                lock_guard<SpinLock> hold(guard.lock);
+                inventory = item->inventory.load(memory_order_relaxed);
+                shipping = item->shipping.load(memory_order_relaxed);
+            }
+        }
+        if (inventory > 0) {
+            cout << "Found in Inventory: " << name << " (" << inventory << ")" << endl;
+        } else if (shipping > 0) {
+            cout << "Found in Shipping Queue: " << name << " (" << shipping << ")" << endl;
+        } else {
+            cout << "Item not found: " << name << endl;
+        }
+    }
+
+    void viewAll() const {
+        vector<pair<const NameState*, long long>> stack;
+        vector<pair<const NameState*, long long>> queue;
+        readEnds([&] {
+            stack.clear();
+            queue.clear();
+            const SlotBuffer* slots = stackSlots.load(memory_order_acquire);
+            size_t size = min(stackSize.load(memory_order_acquire), slots->capacity);
+            for (size_t i = size; i > 0; i--) {
+                addRun(stack, slots->slots[i - 1]);
+            }
+            const SlotBuffer* ring = queueSlots.load(memory_order_acquire);
+            uint64_t head = queueHead.load(memory_order_acquire);
+            uint64_t tail = queueTail.load(memory_order_acquire);
+            if (tail - head > ring->capacity) tail = head;  // torn read, retried
+            for (uint64_t pos = head; pos < tail; pos++) {
+                addRun(queue, ring->slots[pos & (ring->capacity - 1)]);
+            }
+        });
+        cout << "\n--- Current Inventory ---" << endl;
+        if (stack.empty()) {
+            cout << "Inventory is empty." << endl;
+        } else {
+            cout << "Inventory items (top to bottom): ";
+            printRuns(stack);
+        }
+        cout << "--- Current Shipping Queue ---" << endl;
+        if (queue.empty()) {
+            cout << "Shipping queue is empty." << endl;
+        } else {
+            cout << "Shipping queue items (front to rear): ";
+            printRuns(queue);
+        }
+    }
+};
+
+// Epoch-based reclamation for the lock-free containers. A thread pins the
+// global epoch (EpochGuard) while it may hold pointers to shared nodes.
+// Unlinked nodes are retired with the epoch they were unlinked in and freed
+// once the epoch has advanced twice since, by which time no pinned thread
+// can still see them. The epoch advances when every pinned thread has
+// caught up with it.
+class EpochDomain {
+public:
+    static constexpr size_t MAX_THREADS = 256;
+
+private:
+    static constexpr size_t COLLECT_EVERY = 64;
+
+    struct alignas(64) ThreadSlot {
+        atomic<uint64_t> pinned{0};  // epoch * 2 + 1 while pinned, 0 otherwise
+        atomic<bool> taken{false};
+    };
+
+    struct Retired {
+        void* node;
+        void (*destroy)(void*);
+        uint64_t epoch;
+    };
+
+    // Per-thread state; a thread's leftovers are handed to the domain on exit
+    struct Local {
+        size_t slot = MAX_THREADS;
+        vector<Retired> limbo;
+
+        ~Local();
+    };
+
+    atomic<uint64_t> epoch{1};
+    ThreadSlot slots[MAX_THREADS];
+    mutex orphanLock;
+    vector<Retired> orphans;
+
+    static Local& local() {
+        thread_local Local state;
+        return state;
+    }
+
+    void tryAdvance() {
+        uint64_t current = epoch.load(memory_order_seq_cst);
+        for (const ThreadSlot& slot : slots) {
+            uint64_t pinned = slot.pinned.load(memory_order_seq_cst);
+            if ((pinned & 1) && (pinned >> 1) != current) return;
+        }
+        epoch.compare_exchange_strong(current, current + 1, memory_order_seq_cst);
+    }
+
+    // Free every entry retired at least two epochs ago
+    static void freeExpired(vector<Retired>& retired, uint64_t current) {
+        size_t kept = 0;
+        for (Retired& r : retired) {
+            if (r.epoch + 2 <= current) {
+                r.destroy(r.node);
+            } else {
+                retired[kept++] = r;
+            }
+        }
+        retired.resize(kept);
+    }
+
+    void collect(Local& state) {
+        tryAdvance();
+        uint64_t current = epoch.load(memory_order_seq_cst);
+        freeExpired(state.limbo, current);
+        unique_lock<mutex> hold(orphanLock, try_to_lock);
+        if (hold.owns_lock()) freeExpired(orphans, current);
+    }
+
+public:
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    ~EpochDomain() {
+        for (Retired& r : orphans) {
+            r.destroy(r.node);
+        }
+    }
+
+    void enter() {
+        Local& state = local();
+        if (state.slot == MAX_THREADS) {
+            for (size_t i = 0; i < MAX_THREADS; i++) {
+                bool expected = false;
+                if (slots[i].taken.compare_exchange_strong(expected, true)) {
+                    state.slot = i;
+                    break;
+                }
+            }
+            if (state.slot == MAX_THREADS) {
+                throw runtime_error("Too many threads using lock-free containers.");
+            }
+        }
+        slots[state.slot].pinned.store(epoch.load(memory_order_relaxed) * 2 + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+
+    void exit() {
+        slots[local().slot].pinned.store(0, memory_order_release);
+    }
+
+    // Free node with destroy once no pinned thread can still reach it
+    void retire(void* node, void (*destroy)(void*)) {
+        Local& state = local();
+        state.limbo.push_back({node, destroy, epoch.load(memory_order_relaxed)});
+        if (state.limbo.size() % COLLECT_EVERY == 0) collect(state);
+    }
+
+    friend struct Local;
+};
+
+EpochDomain& epochDomain() {
+    static EpochDomain domain;
+    return domain;
+}
+
+EpochDomain::Local::~Local() {
+    EpochDomain& domain = epochDomain();
+    if (slot != MAX_THREADS) {
+        domain.slots[slot].pinned.store(0, memory_order_release);
+        domain.slots[slot].taken.store(false, memory_order_release);
+    }
+    lock_guard<mutex> hold(domain.orphanLock);
+    domain.orphans.insert(domain.orphans.end(), limbo.begin(), limbo.end());
+}
+
+// Pins the current epoch for one operation on a lock-free container
+class EpochGuard {
+public:
+    EpochGuard() { epochDomain().enter(); }
+    ~EpochGuard() { epochDomain().exit(); }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Lock-free multi-producer/multi-consumer shipping queue (Michael-Scott
+// list with a dummy head). Entries keep ShippingQueue's quantity
+// semantics: consumers take units off the front entry by CAS on its
+// quantity, and whoever empties it unlinks it; a consumer that finds the
+// front already empty helps unlink it. Unlinked nodes go through
+// epochDomain(). Adjacent entries for the same item are not merged.
+class LockFreeShippingQueue {
+private:
+    struct Node {
+        atomic<Node*> next{nullptr};
+        uint32_t itemId;
+        atomic<int> quantity;
+
+        Node(uint32_t itemId, int quantity) : itemId(itemId), quantity(quantity) {}
+    };
+
+    alignas(64) atomic<Node*> head;   // dummy; the front entry is head->next
+    alignas(64) atomic<Node*> tail;
+    alignas(64) atomic<long long> units{0};
+
+    static void destroy(void* node) {
+        delete static_cast<Node*>(node);
+    }
+
+    void unlinkFront(Node* first, Node* next) {
+        if (head.compare_exchange_strong(first, next, memory_order_acq_rel)) {
+            epochDomain().retire(first, destroy);
+        }
+    }
+
+public:
+    LockFreeShippingQueue() {
+        Node* dummy = new Node(0, 0);
+        head.store(dummy);
+        tail.store(dummy);
+    }
+
+    // Not safe against concurrent use, like any destructor
+    ~LockFreeShippingQueue() {
+        Node* current = head.load();
+        while (current != nullptr) {
+            Node* next = current->next.load();
+            delete current;
+            current = next;
+        }
+    }
+
+    LockFreeShippingQueue(const LockFreeShippingQueue&) = delete;
+    LockFreeShippingQueue& operator=(const LockFreeShippingQueue&) = delete;
+
+    void enqueue(uint32_t itemId, int qty = 1) {
+        Node* node = new Node(itemId, qty);
+        units.fetch_add(qty, memory_order_relaxed);
+        EpochGuard guard;
+        while (true) {
+            Node* last = tail.load(memory_order_acquire);
+            Node* next = last->next.load(memory_order_acquire);
+            if (last != tail.load(memory_order_acquire)) continue;
+            if (next != nullptr) {
+                tail.compare_exchange_weak(last, next, memory_order_acq_rel);  // help a lagging tail
+                continue;
+            }
+            if (last->next.compare_exchange_weak(next, node, memory_order_acq_rel)) {
+                tail.compare_exchange_strong(last, node, memory_order_acq_rel);
+                return;
+            }
+        }
+    }
+
+    // Take up to n units of the front entry; returns how many were taken
+    // (0 when the queue is empty) and their item in itemId
+    int dequeueUpTo(int n, uint32_t& itemId) {
+        EpochGuard guard;
+        while (true) {
+            Node* first = head.load(memory_order_acquire);
+            Node* last = tail.load(memory_order_acquire);
+            Node* next = first->next.load(memory_order_acquire);
+            if (first != head.load(memory_order_acquire)) continue;
+            if (next == nullptr) return 0;
+            if (first == last) {
+                tail.compare_exchange_weak(last, next, memory_order_acq_rel);
+                continue;
+            }
+            int qty = next->quantity.load(memory_order_acquire);
+            while (qty > 0) {
+                int taken = min(qty, n);
+                if (next->quantity.compare_exchange_weak(qty, qty - taken, memory_order_acq_rel)) {
+                    itemId = next->itemId;
+                    units.fetch_sub(taken, memory_order_relaxed);
+                    if (taken == qty) unlinkFront(first, next);
+                    return taken;
+                }
+            }
+            unlinkFront(first, next);  // emptied by another consumer
+        }
+    }
+
+    // Take one unit; false when the queue is empty
+    bool dequeue(uint32_t& itemId) {
+        return dequeueUpTo(1, itemId) == 1;
+    }
+
+    // Take up to n units across entries, appending them to manifest as runs
+    long long dequeueBatch(long long n, vector<ManifestLine>& manifest) {
+        long long taken = 0;
+        while (taken < n) {
+            uint32_t itemId;
+            int qty = dequeueUpTo(static_cast<int>(min<long long>(n - taken, numeric_limits<int>::max())), itemId);
+            if (qty == 0) break;
+            if (!manifest.empty() && manifest.back().itemId == itemId) {
+                manifest.back().quantity += qty;
+            } else {
+                manifest.push_back({itemId, qty});
+            }
+            taken += qty;
+        }
+        return taken;
+    }
+
+    // Both are snapshots that may be stale by the time they return
+    bool isEmpty() const {
+        EpochGuard guard;
+        Node* first = head.load(memory_order_acquire);
+        Node* next = first->next.load(memory_order_acquire);
+        return next == nullptr || (next->quantity.load(memory_order_acquire) == 0
+                                   && next->next.load(memory_order_acquire) == nullptr);
+    }
+
+    long long unitCount() const {
+        return units.load(memory_order_relaxed);
+    }
+};
+
+// Lock-free inventory stack (Treiber stack) with an elimination array.
+// Pushing the item already on top adds to that entry's quantity, as in
+// InventoryStack::push, by CAS on the quantity; an entry whose quantity
+// reaches 0 is dead for good and is unlinked by whoever finds it on top.
+// Because entries are modified in place, a push or pop that races with a
+// push of a new entry may act on the entry just below it; it then takes
+// effect as if it had finished before that push. Single-unit pushes and
+// pops that keep losing the race for the top meet in the elimination
+// array instead and cancel without touching it.
+class LockFreeInventoryStack {
+private:
+    static constexpr size_t ELIMINATION_SLOTS = 16;
+    static constexpr int ELIMINATION_WAIT = 32;   // polls before a push withdraws its offer
+    static constexpr uint64_t SLOT_EMPTY = 0;
+    static constexpr uint64_t SLOT_TAKEN = 1;     // offer accepted, waiting for the pusher to clear it
+
+    struct Node {
+        Node* next;
+        uint32_t itemId;
+        atomic<int> quantity;
+
+        Node(uint32_t itemId, int quantity) : next(nullptr), itemId(itemId), quantity(quantity) {}
+    };
+
+    struct alignas(64) EliminationSlot {
+        atomic<uint64_t> state{SLOT_EMPTY};  // SLOT_EMPTY, SLOT_TAKEN or an offer()
+    };
+
+    alignas(64) atomic<Node*> top{nullptr};
+    alignas(64) atomic<long long> units{0};
+    EliminationSlot slots[ELIMINATION_SLOTS];
+
+    static void destroy(void* node) {
+        delete static_cast<Node*>(node);
+    }
+
+    static uint64_t offer(uint32_t itemId) {
+        return (static_cast<uint64_t>(itemId) << 2) | 2;
+    }
+
+    static EliminationSlot& pickSlot(EliminationSlot* slots) {
+        thread_local unsigned state = static_cast<unsigned>(hash<thread::id>()(this_thread::get_id()));
+        state = state * 1103515245u + 12345u;
+        return slots[(state >> 16) % ELIMINATION_SLOTS];
+    }
+
+    // Offer one unit of itemId to a waiting pop; true if one took it
+    bool eliminatePush(uint32_t itemId) {
+        EliminationSlot& slot = pickSlot(slots);
+        uint64_t expected = SLOT_EMPTY;
+        if (!slot.state.compare_exchange_strong(expected, offer(itemId), memory_order_acq_rel)) return false;
+        for (int i = 0; i < ELIMINATION_WAIT; i++) {
+            if (slot.state.load(memory_order_acquire) == SLOT_TAKEN) break;
+            this_thread::yield();
+        }
+        expected = offer(itemId);
+        if (slot.state.compare_exchange_strong(expected, SLOT_EMPTY, memory_order_acq_rel)) return false;
+        slot.state.store(SLOT_EMPTY, memory_order_release);  // a pop accepted it
+        return true;
+    }
+
+    // Accept a unit offered by a concurrent push, if one is waiting
+    static bool eliminatePop(EliminationSlot* slots, uint32_t& itemId) {
+        EliminationSlot& slot = pickSlot(slots);
+        uint64_t state = slot.state.load(memory_order_acquire);
+        if (state == SLOT_EMPTY || state == SLOT_TAKEN) return false;
+        if (!slot.state.compare_exchange_strong(state, SLOT_TAKEN, memory_order_acq_rel)) return false;
+        itemId = static_cast<uint32_t>(state >> 2);
+        return true;
+    }
+
+    void unlinkTop(Node* node) {
+        if (top.compare_exchange_strong(node, node->next, memory_order_acq_rel)) {
+            epochDomain().retire(node, destroy);
+        }
+    }
+
+public:
+    LockFreeInventoryStack() = default;
+
+    // Not safe against concurrent use, like any destructor
+    ~LockFreeInventoryStack() {
+        Node* current = top.load();
+        while (current != nullptr) {
+            Node* next = current->next;
+            delete current;
+            current = next;
+        }
+    }
+
+    LockFreeInventoryStack(const LockFreeInventoryStack&) = delete;
+    LockFreeInventoryStack& operator=(const LockFreeInventoryStack&) = delete;
+
+    void push(uint32_t itemId, int qty = 1) {
+        units.fetch_add(qty, memory_order_relaxed);
+        EpochGuard guard;
+        Node* node = nullptr;
+        while (true) {
+            Node* current = top.load(memory_order_acquire);
+            if (current != nullptr && current->itemId == itemId) {
+                int have = current->quantity.load(memory_order_acquire);
+                if (have > 0 && current->quantity.compare_exchange_weak(have, have + qty, memory_order_acq_rel)) {
+                    delete node;
+                    return;
+                }
+                if (have == 0) {
+                    unlinkTop(current);
+                    continue;
+                }
+            } else {
+                if (node == nullptr) node = new Node(itemId, qty);
+                node->next = current;
+                if (top.compare_exchange_weak(current, node, memory_order_acq_rel)) {
+                    return;
+                }
+            }
+            if (qty == 1 && eliminatePush(itemId)) {
+                units.fetch_sub(1, memory_order_relaxed);
+                delete node;
+                return;
+            }
+        }
+    }
+
+    // Take one unit off the top; false when the stack is empty
+    bool pop(uint32_t& itemId) {
+        EpochGuard guard;
+        while (true) {
+            Node* current = top.load(memory_order_acquire);
+            if (current == nullptr) return false;
+            int have = current->quantity.load(memory_order_acquire);
+            if (have == 0) {
+                unlinkTop(current);
+                continue;
+            }
+            if (current->quantity.compare_exchange_weak(have, have - 1, memory_order_acq_rel)) {
+                itemId = current->itemId;
+                units.fetch_sub(1, memory_order_relaxed);
+                if (have == 1) unlinkTop(current);
+                return true;
+            }
+            if (eliminatePop(slots, itemId)) return true;
+        }
+    }
+
+    // Both are snapshots that may be stale by the time they return
+    bool isEmpty() const {
+        EpochGuard guard;
+        Node* current = top.load(memory_order_acquire);
+        while (current != nullptr && current->quantity.load(memory_order_acquire) == 0) {
+            current = current->next;
+        }
+        return current == nullptr;
+    }
+
+    long long unitCount() const {
+        return units.load(memory_order_relaxed);
+    }
+};
+
+// Thread pool where each worker keeps its own deque of tasks: it runs its
+// newest task first and, when it has none, steals the oldest task of
+// another worker. Tasks submitted from a worker go to its own deque, so a
+// stage's follow-up work stays on the thread that has its data in cache.
+class WorkStealingPool {
+private:
+    struct alignas(64) Worker {
+        SpinLock lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    atomic<size_t> queued{0};    // tasks sitting in deques
+    atomic<size_t> pending{0};   // tasks submitted and not yet finished
+    atomic<size_t> sleepers{0};
+    atomic<size_t> nextWorker{0};
+    atomic<bool> stopping{false};
+    mutex sleepLock;
+    condition_variable wake;
+    condition_variable idle;
+
+    static thread_local WorkStealingPool* currentPool;
+    static thread_local size_t currentWorker;
+
+    bool takeTask(size_t self, function<void()>& task) {
+        {
+            lock_guard<SpinLock> hold(workers[self]->lock);
+            if (!workers[self]->tasks.empty()) {
+                task = move(workers[self]->tasks.back());
+                workers[self]->tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(self + i) % workers.size()];
+            lock_guard<SpinLock> hold(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t self) {
+        currentPool = this;
+        currentWorker = self;
+        function<void()> task;
+        while (true) {
+            if (takeTask(self, task)) {
+                queued.fetch_sub(1);
+                task();
+                task = nullptr;
+                if (pending.fetch_sub(1) == 1) {
+                    lock_guard<mutex> hold(sleepLock);
+                    idle.notify_all();
+                }
+                continue;
+            }
+            unique_lock<mutex> hold(sleepLock);
+            sleepers.fetch_add(1);
+            wake.wait(hold, [this] { return queued.load() > 0 || stopping.load(); });
+            sleepers.fetch_sub(1);
+            if (stopping.load() && queued.load() == 0) return;
+        }
+    }
+
+public:
+    explicit WorkStealingPool(unsigned threadCount) {
+        if (threadCount == 0) threadCount = 1;
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.push_back(make_unique<Worker>());
+        }
+        for (unsigned i = 0; i < threadCount; i++) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+
+    // Runs every task already submitted, then stops the workers
+    ~WorkStealingPool() {
+        wait();
+        {
+            lock_guard<mutex> hold(sleepLock);
+            stopping.store(true);
+        }
+        wake.notify_all();
+        for (thread& worker : threads) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    void submit(function<void()> task) {
+        pending.fetch_add(1);
+        size_t target = currentPool == this ? currentWorker : nextWorker.fetch_add(1) % workers.size();
+        {
+            lock_guard<SpinLock> hold(workers[target]->lock);
+            workers[target]->tasks.push_back(move(task));
+        }
+        queued.fetch_add(1);
+        if (sleepers.load() > 0) {
+            lock_guard<mutex> hold(sleepLock);
+            wake.notify_one();
+        }
+    }
+
+    // Block until every submitted task, including ones they submit, is done
+    void wait() {
+        unique_lock<mutex> hold(sleepLock);
+        idle.wait(hold, [this] { return pending.load() == 0; });
+    }
+
+    size_t backlog() const {
+        return queued.load(memory_order_relaxed);
+    }
+};
+
+thread_local WorkStealingPool* WorkStealingPool::currentPool = nullptr;
+thread_local size_t WorkStealingPool::currentWorker = 0;
+
+// Units taken off the inventory together, in pick (LIFO) order
+struct PickBatch {
+    uint64_t seq;                 // position in pick order
+    vector<ManifestLine> lines;
+    long long units;
+};
+
+// Runs inventory -> shipping as three stages on a WorkStealingPool:
+// receive checks a receipt batch and pushes it onto the inventory stack,
+// pick takes up to PICK_BATCH units off its top and numbers the batch, and
+// process drops held items and labels the batch off-lock before handing
+// it to the shipping stage. Picks are numbered under the inventory lock and the
+// shipping stage enqueues batches strictly by number, holding early
+// finishers back, so the queue sees units in the stack's LIFO order even
+// though batches are processed in parallel. Lines within a receipt batch
+// are pushed in order; separate receipt batches have no order between them.
+class ProcessingPipeline {
+public:
+    static constexpr long long PICK_BATCH = 256;
+
+    using LabelHook = function<void(const PickBatch&)>;
+
+    // Units at each stage boundary, for reporting depth
+    struct Counters {
+        atomic<long long> received{0};
+        atomic<long long> picked{0};
+        atomic<long long> shipped{0};
+        atomic<long long> rejected{0};   // picked, but on hold
+        atomic<long long> refused{0};    // never received, see receive
+    };
+
+private:
+    WorkStealingPool& pool;
+    NodePool inventoryNodes;   // one pool per side, since each has its own lock
+    NodePool shippingNodes;
+    mutex inventoryLock;
+    InventoryStack inventory;
+    mutex shippingLock;
+    ShippingQueue shipping;
+    uint64_t nextPick;                   // guarded by inventoryLock
+    uint64_t nextShip;                   // guarded by shippingLock
+    map<uint64_t, PickBatch> waiting;    // processed batches ahead of nextShip
+    // Fixed when the pipeline is built, so workers read them without a lock
+    // and never touch the shared dictionary
+    size_t knownItems;
+    vector<char> onHold;                 // by item id
+    LabelHook labelHook;
+    Counters counters;
+
+    bool pick(PickBatch& batch) {
+        lock_guard<mutex> hold(inventoryLock);
+        batch.units = 0;
+        while (batch.units < PICK_BATCH && !inventory.isEmpty()) {
+            uint32_t itemId = inventory.peek();
+            int qty = inventory.quantityOf(itemId);
+            if (qty > PICK_BATCH - batch.units) qty = static_cast<int>(PICK_BATCH - batch.units);
+            inventory.take(itemId, qty);
+            batch.lines.push_back({itemId, qty});
+            batch.units += qty;
+        }
+        if (batch.units == 0) return false;
+        batch.seq = nextPick++;
+        counters.picked.fetch_add(batch.units, memory_order_relaxed);
+        return true;
+    }
+
+    // Drop lines for items on hold, then label
+    void process(PickBatch& batch) {
+        // remove_if leaves the tail unspecified, so count while filtering
+        long long held = 0;
+        auto bad = remove_if(batch.lines.begin(), batch.lines.end(), [this, &held](const ManifestLine& line) {
+            if (onHold[line.itemId] == 0) return false;
+            held += line.quantity;
+            return true;
+        });
+        batch.lines.erase(bad, batch.lines.end());
+        counters.rejected.fetch_add(held, memory_order_relaxed);
+        if (labelHook) labelHook(batch);
+    }
+
+    void ship(PickBatch&& batch) {
+        lock_guard<mutex> hold(shippingLock);
+        if (batch.seq != nextShip) {
+            waiting.emplace(batch.seq, move(batch));
+            return;
+        }
+        while (true) {
+            for (const ManifestLine& line : batch.lines) {
+                shipping.enqueue(line.itemId, static_cast<int>(line.quantity));
+                counters.shipped.fetch_add(line.quantity, memory_order_relaxed);
+            }
+            nextShip++;
+            auto next = waiting.find(nextShip);
+            if (next == waiting.end()) return;
+            batch = move(next->second);
+            waiting.erase(next);
+        }
+    }
+
+    void pickTask() {
+        PickBatch batch;
+        if (!pick(batch)) return;
+        process(batch);
+        ship(move(batch));
+    }
+
+public:
+    // Items interned after this point are refused; held items are picked
+    // but never reach the shipping queue
+    explicit ProcessingPipeline(WorkStealingPool& pool, LabelHook labelHook = nullptr,
+                                const vector<uint32_t>& holds = {})
+        : pool(pool), inventory(inventoryNodes), shipping(shippingNodes), nextPick(0), nextShip(0),
+          knownItems(skuDictionary().size()), onHold(knownItems, 0), labelHook(move(labelHook)) {
+        for (uint32_t itemId : holds) {
+            if (itemId < knownItems) onHold[itemId] = 1;
+        }
+    }
+
+    // Queue a receipt batch; one pick task follows per PICK_BATCH units.
+    // Lines for unknown items or with a quantity outside 1..INT_MAX are
+    // refused here, on the caller's thread.
+    void receive(vector<ManifestLine> lines) {
+        long long refused = 0;
+        auto bad = remove_if(lines.begin(), lines.end(), [this, &refused](const ManifestLine& line) {
+            if (line.itemId < knownItems && line.quantity > 0 && line.quantity <= numeric_limits<int>::max()) {
+                return false;
+            }
+            refused += max(line.quantity, 0LL);
+            return true;
+        });
+        lines.erase(bad, lines.end());
+        counters.refused.fetch_add(refused, memory_order_relaxed);
+        if (lines.empty()) return;
+        pool.submit([this, lines = move(lines)] {
+            long long units = 0;
+            {
+                lock_guard<mutex> hold(inventoryLock);
+                for (const ManifestLine& line : lines) {
+                    inventory.push(line.itemId, static_cast<int>(line.quantity));
+                    units += line.quantity;
+                }
+            }
+            counters.received.fetch_add(units, memory_order_relaxed);
+            for (long long i = 0; i < units; i += PICK_BATCH) {
+                pool.submit([this] { pickTask(); });
+            }
+        });
+    }
+
+    // Wait for the stages to run dry. Picks racing with receives can come
+    // up short, so sweep whatever they left on the stack.
+    void drain() {
+        while (true) {
+            pool.wait();
+            size_t left;
+            {
+                lock_guard<mutex> hold(inventoryLock);
+                left = static_cast<size_t>((inventory.unitCount() + PICK_BATCH - 1) / PICK_BATCH);
+            }
+            if (left == 0) return;
+            for (size_t i = 0; i < left; i++) {
+                pool.submit([this] { pickTask(); });
+            }
+        }
+    }
+
+    const Counters& stageCounters() const { return counters; }
+
+    // Only meaningful once drained
+    const ShippingQueue& shippingQueue() const { return shipping; }
+    size_t heldBack() const { return waiting.size(); }
+};
+
+// Function to display menu for Warehouse System
 void displayWarehouseMenu() {
     cout << "\n=== Warehouse Inventory and Shipping System ===" << endl;
     cout << "1. Add Incoming Item" << endl;
@@ -443,159 +3256,1666 @@ void displayWarehouseMenu() {
     cout << "7. Remove Item by Name\n";
     cout << "8. Search Item\n";
     cout << "9. Count Items\n";
-    cout << "10. Exit\n";
+    cout << "10. Process Multiple Items\n";
+    cout << "11. Process All Items\n";
+    cout << "12. Ship Multiple Items\n";
+    cout << "13. Import Receipts File (CSV/TSV)\n";
+    cout << "14. View Dock Status\n";
+    cout << "15. Receive Lot (with expiry date)\n";
+    cout << "16. Process Lot Stock (earliest expiry first)\n";
+    cout << "17. Expire Lots Before Date\n";
+    cout << "18. Set Item Shipping Priority\n";
+    cout << "19. Switch Shipping Mode (FIFO / priority)\n";
+    cout << "20. Exit\n";
+
+    cout << "Enter your choice: ";
+}
+
+// Dock setup from the command line, applied by loadWarehouse
+struct DockSettings {
+    size_t count = 1;
+    DockPolicy policy = DOCK_ROUND_ROBIN;
+    int priorityShipping = -1;  // 1 priority, 0 FIFO, -1 as saved
+};
+
+DockSettings startupDocks;
+
+// Load the saved state and start journaling and checkpoints
+void loadWarehouse(WarehouseSystem& warehouse, const JournalPolicy& policy = JournalPolicy()) {
+    // Prefer the binary snapshot; result.txt stays as the plain-text copy
+    // and is read instead when the snapshot is rejected
+    if (!ifstream("result.snap") || !warehouse.loadFromFile("result.snap")) {
+        warehouse.loadFromFile("result.txt");
+    }
+    warehouse.openJournal("result.journal", policy);
+    warehouse.configureDocks(startupDocks.count, startupDocks.policy);
+    if (startupDocks.priorityShipping >= 0) warehouse.usePriorityShipping(startupDocks.priorityShipping == 1);
+    warehouse.enableCheckpoints("result.txt", "result.snap", CHECKPOINT_INTERVAL);
+}
+
+// Ship up to count units from a dock and report them as the menu does
+void shipAndReport(WarehouseSystem& warehouse, long long count, size_t dock = 0) {
+    vector<ManifestLine> manifest = warehouse.shipBatch(count, dock);
+    if (manifest.empty()) {
+        cout << "No items to ship.!" << endl;
+        return;
+    }
+    long long shipped = 0;
+    for (const ManifestLine& line : manifest) {
+        shipped += line.quantity;
+    }
+    cout << "Shipped " << shipped << " item(s) in " << manifest.size() << " line(s)." << endl;
+    warehouse.saveManifest(manifest, "manifest.txt");
+}
+
+// Ask for a shipping class and ship-by date; false on bad input
+bool readShipTerms(ShipTerms& terms) {
+    string word;
+    cout << "Enter shipping class (express/standard/economy): ";
+    cin >> word;
+    if (!parseShipClass(word, terms.shipClass)) {
+        cout << "Invalid class! Use express, standard or economy." << endl;
+        return false;
+    }
+    cout << "Enter ship-by date (YYYY-MM-DD, or - for none): ";
+    cin >> word;
+    if (!parseDeadline(word, terms.deadline)) {
+        cout << "Invalid date! Use YYYY-MM-DD or -." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Ask which dock to ship from when there is more than one; false on bad input
+bool readDock(const WarehouseSystem& warehouse, size_t& dock) {
+    dock = 0;
+    if (warehouse.dockCount() == 1) return true;
+    long long number;
+    cout << "Enter dock number (1-" << warehouse.dockCount() << "): ";
+    cin >> number;
+    if (cin.fail() || number <= 0 || static_cast<size_t>(number) > warehouse.dockCount()) {
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << "Invalid dock! Must be between 1 and " << warehouse.dockCount() << "." << endl;
+        return false;
+    }
+    dock = static_cast<size_t>(number - 1);
+    return true;
+}
+
+// Function to run the Warehouse System
+void runWarehouseSystem() {
+    WarehouseSystem warehouse;
+    loadWarehouse(warehouse);
+    int choice;
+
+    do {
+        warehouse.checkpointIfDue();
+        displayWarehouseMenu();
+        cin >> choice;
+
+        // Input validation
+        if (cin.fail()) {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Please enter a number." << endl;
+            continue;
+        }
+
+        switch (choice) {
+            case 1: {
+                string itemName;
+                int qty;
+                cout << "Enter item name: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, itemName);
+                cout << "Enter quantity: ";
+                cin >> qty;
+                if (cin.fail() || qty <= 0) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid quantity! Must be a positive integer." << endl;
+                    break;
+                }
+                try {
+                    itemName = checkedItemName(itemName);
+                    ShipTerms terms;
+                    if (!warehouse.isPriorityShipping()) {
+                        warehouse.addItem(itemName, qty);
+                    } else if (readShipTerms(terms)) {
+                        warehouse.addItem(itemName, qty, terms);
+                    }
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+
+                break;
+            }
+            case 2:
+                warehouse.processItem();
+                break;
+            case 3: {
+                size_t dock;
+                if (readDock(warehouse, dock)) warehouse.shipItem(dock);
+                break;
+            }
+            case 4:
+                warehouse.viewLastIncoming();
+                break;
+            case 5:
+                warehouse.viewNextShipment();
+                break;
+            case 6:
+                warehouse.viewAll();
+                break;
+
+            case 7: {
+                if (warehouse.isEmpty()) {
+                    cout << "System is empty. No items to remove. Please add items first." << endl;
+                    break;
+                }
+                string name;
+                cout << "Enter item name to remove: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, name);
+
+                try {
+                    warehouse.removeItem(checkedItemName(name));
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+
+            break;
+        }
+
+            case 8: {
+                if (warehouse.isEmpty()) {
+                    cout << "System is empty. Please add items first before searching." << endl;
+                    break;
+                }
+                string searchName;
+                cout << "Enter item name to search: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, searchName);
+                try {
+                    warehouse.searchItem(checkedItemName(searchName));
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+                break;
+            }
+
+            case 9: {
+                    if (warehouse.isEmpty()) {
+                    cout << "System is empty. Total items: 0" << endl;
+                    break;
+                }
+                warehouse.countItems();
+                break;
+            }
+
+            case 10: {
+                long long count;
+                cout << "Enter number of items to process: ";
+                cin >> count;
+                if (cin.fail() || count <= 0) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid number! Must be a positive integer." << endl;
+                    break;
+                }
+                warehouse.processN(count);
+                break;
+            }
+
+            case 11:
+                warehouse.processAll();
+                break;
+
+            case 12: {
+                long long count;
+                cout << "Enter number of items to ship: ";
+                cin >> count;
+                if (cin.fail() || count <= 0) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid number! Must be a positive integer." << endl;
+                    break;
+                }
+                size_t dock;
+                if (readDock(warehouse, dock)) shipAndReport(warehouse, count, dock);
+                break;
+            }
+
+            case 13: {
+                string filename;
+                cout << "Enter receipts file name: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, filename);
+                try {
+                    ImportStats stats = warehouse.importReceipts(filename);
+                    cout << "Imported " << stats.rows << " row(s) from " << filename;
+                    if (stats.rejected > 0) {
+                        cout << " (" << stats.rejected << " rejected, first at line " << stats.firstRejected << ")";
+                    }
+                    cout << endl;
+                    double seconds = max(stats.seconds, 1e-9);
+                    cout << "  " << stats.bytes / 1e6 << " MB in " << stats.seconds << " s: "
+                         << static_cast<long long>(stats.rows / seconds) << " rows/s, "
+                         << stats.bytes / 1e6 / seconds << " MB/s" << endl;
+                } catch (const runtime_error& e) {
+                    cout << e.what() << endl;
+                }
+                break;
+            }
+
+            case 14:
+                warehouse.viewDockStatus();
+                break;
+
+            case 15: {
+                string itemName;
+                string date;
+                int qty;
+                unsigned long long lotId;
+                int32_t expiry;
+                cout << "Enter item name: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, itemName);
+                cout << "Enter quantity: ";
+                cin >> qty;
+                if (cin.fail() || qty <= 0) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid quantity! Must be a positive integer." << endl;
+                    break;
+                }
+                cout << "Enter lot number: ";
+                cin >> lotId;
+                if (cin.fail()) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid lot number! Must be a non-negative integer." << endl;
+                    break;
+                }
+                cout << "Enter expiry date (YYYY-MM-DD): ";
+                cin >> date;
+                if (!parseDate(date, expiry)) {
+                    cout << "Invalid date! Use YYYY-MM-DD." << endl;
+                    break;
+                }
+                try {
+                    warehouse.receiveLot(checkedItemName(itemName), qty, lotId, expiry);
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+                break;
+            }
+
+            case 16: {
+                string itemName;
+                int qty;
+                cout << "Enter item name: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, itemName);
+                cout << "Enter quantity: ";
+                cin >> qty;
+                if (cin.fail() || qty <= 0) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid quantity! Must be a positive integer." << endl;
+                    break;
+                }
+                try {
+                    warehouse.processLot(checkedItemName(itemName), qty);
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+                break;
+            }
+
+            case 17: {
+                string date;
+                int32_t before;
+                cout << "Expire lots dated before (YYYY-MM-DD): ";
+                cin >> date;
+                if (!parseDate(date, before)) {
+                    cout << "Invalid date! Use YYYY-MM-DD." << endl;
+                    break;
+                }
+                warehouse.expireLots(before);
+                break;
+            }
+
+            case 18: {
+                string itemName;
+                ShipTerms terms;
+                cout << "Enter item name: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, itemName);
+                try {
+                    itemName = checkedItemName(itemName);
+                    if (readShipTerms(terms)) warehouse.setShipTerms(itemName, terms);
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+                break;
+            }
+
+            case 19:
+                warehouse.usePriorityShipping(!warehouse.isPriorityShipping());
+                break;
+
+            case 20:
+                cout << "Exiting Warehouse System. Goodbye!" << endl;
+                saveWarehouse(warehouse);
+                break;
+
+            default:
+                cout << "Invalid choice! Please try again." << endl;
+        }
+    } while (choice != 20);
+}
+
+// Batch commands, one per line; blank lines and lines starting with # are
+// skipped:
+//   add <qty> <name>      process [<n>|all]     ship [<n> [<dock>]]
+//   remove <name>         search <name>         count
+//   view                  last                  next
+//   import <file>         docks                 flush
+//   lot <qty> <lot> <YYYY-MM-DD> <name>         fefo <n> <name>
+//   expire <YYYY-MM-DD>   shipping fifo|priority
+//   terms <express|standard|economy> <YYYY-MM-DD|-> <name>
+// Output is buffered and written when the buffer fills, on "flush" and at
+// the end; the operation rate goes to stderr. path "-" reads stdin.
+int runBatch(const string& path) {
+    FILE* in = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        cerr << "Could not open " << path << endl;
+        return 1;
+    }
+    BatchOutput output(stdout);
+    streambuf* saved = cout.rdbuf(&output);
+
+    WarehouseSystem warehouse;
+    loadWarehouse(warehouse, BATCH_JOURNAL_POLICY);
+    BatchReader reader(in);
+    string_view line;
+    size_t lineNumber = 0;
+    size_t operations = 0;
+    auto started = chrono::steady_clock::now();
+
+    while (reader.next(line)) {
+        lineNumber++;
+        while (!line.empty() && line.front() == ' ') line.remove_prefix(1);
+        if (line.empty() || line.front() == '#') continue;
+        warehouse.checkpointIfDue();
+
+        string_view args = line;
+        string_view verb = nextWord(args);
+        long long count = 0;
+        operations++;
+        try {
+            if (verb == "add") {
+                if (!parseCount(nextWord(args), count) || count > numeric_limits<int>::max()) {
+                    throw invalid_argument("Invalid quantity! Must be a positive integer.");
+                }
+                warehouse.addItem(checkedItemName(string(args)), static_cast<int>(count));
+            } else if (verb == "process") {
+                if (args.empty()) {
+                    warehouse.processItem();
+                } else if (args == "all") {
+                    warehouse.processAll();
+                } else if (parseCount(args, count)) {
+                    warehouse.processN(count);
+                } else {
+                    throw invalid_argument("Invalid number! Must be a positive integer.");
+                }
+            } else if (verb == "ship") {
+                long long dock = 1;
+                if (args.empty()) {
+                    warehouse.shipItem();
+                } else if (!parseCount(nextWord(args), count)) {
+                    throw invalid_argument("Invalid number! Must be a positive integer.");
+                } else if (!args.empty() && (!parseCount(args, dock) || static_cast<size_t>(dock) > warehouse.dockCount())) {
+                    throw invalid_argument("Invalid dock! Must be between 1 and " + to_string(warehouse.dockCount()) + ".");
+                } else {
+                    shipAndReport(warehouse, count, static_cast<size_t>(dock - 1));
+                }
+            } else if (verb == "remove") {
+                warehouse.removeItem(checkedItemName(string(args)));
+            } else if (verb == "search") {
+                warehouse.searchItem(checkedItemName(string(args)));
+            } else if (verb == "count") {
+                warehouse.countItems();
+            } else if (verb == "view") {
+                warehouse.viewAll();
+            } else if (verb == "last") {
+                warehouse.viewLastIncoming();
+            } else if (verb == "next") {
+                warehouse.viewNextShipment();
+            } else if (verb == "import") {
+                ImportStats stats = warehouse.importReceipts(string(args));
+                cout << "Imported " << stats.rows << " row(s) from " << args << endl;
+            } else if (verb == "lot") {
+                long long lotId = 0;
+                int32_t expiry;
+                if (!parseCount(nextWord(args), count) || count > numeric_limits<int>::max()) {
+                    throw invalid_argument("Invalid quantity! Must be a positive integer.");
+                }
+                string_view lotWord = nextWord(args);
+                if (lotWord != "0" && !parseCount(lotWord, lotId)) {
+                    throw invalid_argument("Invalid lot number! Must be a non-negative integer.");
+                }
+                if (!parseDate(nextWord(args), expiry)) {
+                    throw invalid_argument("Invalid date! Use YYYY-MM-DD.");
+                }
+                warehouse.receiveLot(checkedItemName(string(args)), static_cast<int>(count),
+                                     static_cast<uint64_t>(lotId), expiry);
+            } else if (verb == "fefo") {
+                if (!parseCount(nextWord(args), count) || count > numeric_limits<int>::max()) {
+                    throw invalid_argument("Invalid quantity! Must be a positive integer.");
+                }
+                warehouse.processLot(checkedItemName(string(args)), static_cast<int>(count));
+            } else if (verb == "expire") {
+                int32_t before;
+                if (!parseDate(args, before)) {
+                    throw invalid_argument("Invalid date! Use YYYY-MM-DD.");
+                }
+                warehouse.expireLots(before);
+            } else if (verb == "terms") {
+                ShipTerms terms;
+                if (!parseShipClass(nextWord(args), terms.shipClass)) {
+                    throw invalid_argument("Invalid class! Use express, standard or economy.");
+                }
+                if (!parseDeadline(nextWord(args), terms.deadline)) {
+                    throw invalid_argument("Invalid date! Use YYYY-MM-DD or -.");
+                }
+                warehouse.setShipTerms(checkedItemName(string(args)), terms);
+            } else if (verb == "shipping") {
+                if (args != "fifo" && args != "priority") {
+                    throw invalid_argument("Invalid shipping mode! Use fifo or priority.");
+                }
+                warehouse.usePriorityShipping(args == "priority");
+            } else if (verb == "docks") {
+                warehouse.viewDockStatus();
+            } else if (verb == "flush") {
+                output.drain();
+            } else {
+                operations--;
+                cout << "line " << lineNumber << ": unknown command \"" << verb << "\"" << endl;
+            }
+        } catch (const exception& e) {
+            cout << "line " << lineNumber << ": " << e.what() << endl;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    saveWarehouse(warehouse);
+    if (in != stdin) fclose(in);
+    output.drain();
+    cout.rdbuf(saved);
+    cerr << operations << " operation(s) in " << seconds << " s ("
+         << static_cast<long long>(operations / max(seconds, 1e-9)) << " ops/s)" << endl;
+    return 0;
+}
+
+// Name lookup latency as the catalogue grows from 1k items to maxItems by
+// factors of 10. Each item has one inventory entry and one queued entry;
+// a lookup resolves the name in the dictionary, then reads the quantity
+// through the container's name index. For scale, the cost of a single
+// dependent random read over a table with one slot per item is shown
+// alongside: a lookup is a fixed number of such reads at any size.
+int runLookup(size_t maxItems) {
+    const size_t LOOKUPS = 1000000;
+    vector<string> names;
+    vector<uint32_t> ids;
+    mt19937 rng(1);
+    for (size_t items = 1000; items <= maxItems; items *= 10) {
+        while (names.size() < items) {
+            names.push_back("item " + to_string(names.size()));
+            ids.push_back(skuDictionary().intern(names.back()));
+        }
+        NodePool pool;
+        InventoryStack inventory(pool);
+        ShippingQueue shipping(pool);
+        for (size_t i = 0; i < items; i++) {
+            inventory.push(ids[i], 1 + static_cast<int>(i % 4));
+            shipping.enqueue(ids[i], 1 + static_cast<int>(i % 4));
+        }
+        vector<uint32_t> picks(LOOKUPS);
+        for (uint32_t& pick : picks) {
+            pick = static_cast<uint32_t>(rng() % items);
+        }
+
+        long long found = 0;
+        auto started = chrono::steady_clock::now();
+        for (uint32_t pick : picks) {
+            found += inventory.quantityOf(skuDictionary().lookup(names[pick]));
+        }
+        double stackSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        started = chrono::steady_clock::now();
+        for (uint32_t pick : picks) {
+            found += shipping.quantityOf(skuDictionary().lookup(names[pick]));
+        }
+        double queueSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        // A single cycle through every slot (Sattolo's shuffle)
+        vector<uint32_t> cycle(items);
+        for (size_t i = 0; i < items; i++) {
+            cycle[i] = static_cast<uint32_t>(i);
+        }
+        for (size_t i = items - 1; i > 0; i--) {
+            swap(cycle[i], cycle[rng() % i]);
+        }
+        uint32_t at = 0;
+        started = chrono::steady_clock::now();
+        for (size_t i = 0; i < LOOKUPS; i++) {
+            at = cycle[at];
+        }
+        double readSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        found += at;
+
+        cout << items << " items: inventory " << stackSeconds * 1e9 / LOOKUPS << " ns/lookup, shipping "
+             << queueSeconds * 1e9 / LOOKUPS << " ns/lookup, one random read " << readSeconds * 1e9 / LOOKUPS
+             << " ns" << (found > 0 ? "" : "  NOTHING FOUND") << endl;
+    }
+    return 0;
+}
+
+// Receive/ship churn on ItemNodes: hold a working set of live nodes and
+// repeatedly free a random one and allocate its replacement, once through
+// a NodePool and once through global new/delete
+int runChurn(size_t ops) {
+    mt19937 rng(1);
+    for (size_t live : {1000, 100000, 1000000}) {
+        vector<ItemNode*> nodes(live);
+        vector<uint32_t> victims(ops);
+        for (uint32_t& victim : victims) {
+            victim = static_cast<uint32_t>(rng() % live);
+        }
+
+        NodePool pool;
+        for (size_t i = 0; i < live; i++) {
+            nodes[i] = pool.allocate(static_cast<uint32_t>(i), 1);
+        }
+        auto started = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; i++) {
+            pool.release(nodes[victims[i]]);
+            nodes[victims[i]] = pool.allocate(static_cast<uint32_t>(i), 1);
+        }
+        double poolSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        for (size_t i = 0; i < live; i++) {
+            nodes[i] = new ItemNode(static_cast<uint32_t>(i), 1);
+        }
+        started = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; i++) {
+            delete nodes[victims[i]];
+            nodes[victims[i]] = new ItemNode(static_cast<uint32_t>(i), 1);
+        }
+        double heapSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        for (ItemNode* node : nodes) {
+            delete node;
+        }
+
+        cout << live << " live nodes: pool " << poolSeconds * 1e9 / ops << " ns/op, new/delete "
+             << heapSeconds * 1e9 / ops << " ns/op (pool " << pool.slabsInUse() << " slab(s), "
+             << pool.freeNodes() << " free, peak " << pool.peakNodes() << ")" << endl;
+    }
+    return 0;
+}
+
+// Full front-to-rear scans per second of a shipping queue, the pass that
+// displayAll, countItems and the savers make, for the backend this build
+// uses (WAREHOUSE_RING_QUEUE picks the ring buffer). Measured again after
+// one entry in ten is taken out of the middle, which the ring buffer
+// leaves as tombstones until it compacts. The node pool's free list is
+// shuffled first, as it is in a warehouse that has been running a while,
+// so list nodes do not sit in allocation order.
+int runScan(size_t maxEntries) {
+#ifdef WAREHOUSE_RING_QUEUE
+    const char* backend = "ring buffer";
+#else
+    const char* backend = "linked list";
+#endif
+    const size_t ITEMS = 4096;
+    mt19937 rng(1);
+    for (size_t entries : {size_t(1000), size_t(100000), maxEntries}) {
+        NodePool pool;
+        vector<ItemNode*> spare(entries);
+        for (ItemNode*& node : spare) {
+            node = pool.allocate(0, 1);
+        }
+        shuffle(spare.begin(), spare.end(), rng);
+        for (ItemNode* node : spare) {
+            pool.release(node);
+        }
+        ShippingQueue queue(pool);
+        for (size_t i = 0; i < entries; i++) {
+            // Neighbours differ, so no entries merge
+            queue.enqueue(static_cast<uint32_t>(i % ITEMS), 1 + static_cast<int>(i % 4));
+        }
+        size_t scans = max<size_t>(1, 100000000 / entries);
+        auto scanRate = [&]() {
+            long long units = 0;
+            auto started = chrono::steady_clock::now();
+            for (size_t i = 0; i < scans; i++) {
+                for (const auto& entry : queue) {
+                    units += entry.quantity;
+                }
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            if (units != static_cast<long long>(scans) * queue.unitCount()) cout << "  SCAN MISCOUNTED";
+            return scans / max(seconds, 1e-9);
+        };
+        double whole = scanRate();
+        for (size_t i = 0; i < entries / 10; i++) {
+            uint32_t itemId = static_cast<uint32_t>(rng() % ITEMS);
+            int qty = queue.quantityOf(itemId);
+            if (qty > 0) queue.take(itemId, qty);
+        }
+        double holed = scanRate();
+        cout << backend << ", " << entries << " entries: " << static_cast<long long>(whole) << " scans/s ("
+             << whole * entries / 1e6 << "M entries/s), after middle removals "
+             << static_cast<long long>(holed) << " scans/s" << endl;
+    }
+    return 0;
+}
+
+// Units shipped per second through shipItem, one unit and one flushed line
+// per call, against one shipBatch call that writes its manifest file.
+// Console output is dropped, so neither path pays for a terminal.
+int runShipping(long long units) {
+    const string MANIFEST = "shipping_bench_manifest.txt";
+    vector<string> names;
+    for (char a = 'a'; a <= 'p'; a++) {
+        for (char b = 'a'; b <= 'p'; b++) {
+            names.push_back(string("item ") + a + b);
+        }
+    }
+    double seconds[2];
+    for (int pass = 0; pass < 2; pass++) {
+        WarehouseSystem warehouse;
+        mt19937 rng(1);
+        streambuf* saved = cout.rdbuf(nullptr);
+        for (long long stocked = 0; stocked < units;) {
+            int qty = static_cast<int>(min<long long>(1 + rng() % 8, units - stocked));
+            warehouse.addItem(names[rng() % names.size()], qty);
+            stocked += qty;
+        }
+        warehouse.processAll();
 
-    cout << "Enter your choice: ";
+        auto started = chrono::steady_clock::now();
+        if (pass == 0) {
+            for (long long i = 0; i < units; i++) {
+                warehouse.shipItem();
+            }
+        } else {
+            warehouse.saveManifest(warehouse.shipBatch(units), MANIFEST);
+        }
+        seconds[pass] = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        cout.rdbuf(saved);
+        cout.clear();
+        if (!warehouse.isEmpty()) cout << "UNITS LEFT BEHIND" << endl;
+    }
+    remove(MANIFEST.c_str());
+    cout << units << " units: shipItem " << static_cast<long long>(units / max(seconds[0], 1e-9))
+         << " units/s, shipBatch " << static_cast<long long>(units / max(seconds[1], 1e-9)) << " units/s ("
+         << seconds[0] / max(seconds[1], 1e-9) << "x)" << endl;
+    return 0;
 }
 
-// Function to run the Warehouse System
-void runWarehouseSystem() {
-    WarehouseSystem warehouse;
-    warehouse.loadFromFile("result.txt");
-    int choice;
+// Time to tear down a warehouse, split between inventory and shipping, at
+// several entry counts and units per entry; teardown should follow the
+// entry count and not the unit count
+int runTeardown(size_t maxEntries) {
+    vector<string> names;
+    for (char a = 'a'; a <= 'p'; a++) {
+        names.push_back(string("item ") + a);
+    }
+    for (size_t entries : {maxEntries / 10, maxEntries}) {
+        for (int perEntry : {1, 1000, 1000000}) {
+            auto warehouse = make_unique<WarehouseSystem>();
+            streambuf* saved = cout.rdbuf(nullptr);
+            for (size_t i = 0; i < entries; i++) {
+                // Neighbours differ, so no entries merge
+                warehouse->addItem(names[i % names.size()], perEntry);
+            }
+            warehouse->processN(static_cast<long long>(entries / 2) * perEntry);
+            cout.rdbuf(saved);
+            cout.clear();
 
-    do {
-        displayWarehouseMenu();
-        cin >> choice;
+            auto started = chrono::steady_clock::now();
+            warehouse.reset();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            cout << entries << " entries x " << perEntry << " units: " << static_cast<long long>(entries) * perEntry
+                 << " units torn down in " << seconds * 1e3 << " ms" << endl;
+        }
+    }
+    return 0;
+}
 
-        // Input validation
-        if (cin.fail()) {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Please enter a number." << endl;
-            continue;
+// Drop a file from the page cache so the next read of it comes from disk
+void evictFromCache(const string& filename) {
+#ifdef __linux__
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void)filename;
+#endif
+}
+
+// Startup time from the text save and from the binary snapshot of the same
+// warehouse, half its entries in inventory and half in shipping. Files are
+// evicted from the page cache first where the platform allows (Linux), so
+// the loads start cold. The snapshot is then loaded again with a bad record
+// halfway through the shipping records, which must leave the warehouse empty.
+int runColdStart(const vector<size_t>& sizes) {
+    const string TEXT = "coldstart_bench.txt";
+    const string SNAPSHOT = "coldstart_bench.snap";
+    vector<string> names;
+    for (size_t i = 0; i < 4096; i++) {
+        names.push_back("item " + string(1, static_cast<char>('a' + i % 26)) + string(1, static_cast<char>('a' + i / 26 % 26))
+                        + string(1, static_cast<char>('a' + i / 676)));
+    }
+    for (size_t entries : sizes) {
+        streambuf* saved = cout.rdbuf(nullptr);
+        {
+            WarehouseSystem warehouse;
+            for (size_t i = 0; i < entries; i++) {
+                // Neighbours differ, so no entries merge
+                warehouse.addItem(names[i % names.size()], 1 + static_cast<int>(i % 8));
+            }
+            warehouse.processN(static_cast<long long>(entries / 2) * 4);
+            warehouse.saveToFile(TEXT);
+            warehouse.saveSnapshot(SNAPSHOT);
+        }
+        double seconds[2];
+        for (int pass = 0; pass < 2; pass++) {
+            const string& filename = pass == 0 ? TEXT : SNAPSHOT;
+            evictFromCache(filename);
+            WarehouseSystem warehouse;
+            auto started = chrono::steady_clock::now();
+            warehouse.loadFromFile(filename);
+            seconds[pass] = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        }
+        bool rejected;
+        {
+            // Quantity 0 in a shipping record; the stack records come first
+            SnapshotRecord bad = {0, 0};
+            fstream file(SNAPSHOT, ios::in | ios::out | ios::binary);
+            file.seekp(static_cast<streamoff>(filesystem::file_size(SNAPSHOT) - (entries / 4 + 1) * sizeof(bad)));
+            file.write(reinterpret_cast<const char*>(&bad), sizeof(bad));
+            file.close();
+            WarehouseSystem warehouse;
+            rejected = !warehouse.loadFromFile(SNAPSHOT) && warehouse.isEmpty();
         }
+        cout.rdbuf(saved);
+        cout.clear();
+        cout << entries << " entries: text " << seconds[0] << " s (" << filesystem::file_size(TEXT) / 1000000
+             << " MB), snapshot " << seconds[1] << " s (" << filesystem::file_size(SNAPSHOT) / 1000000 << " MB), "
+             << seconds[0] / max(seconds[1], 1e-9) << "x" << endl;
+        if (!rejected) cout << "CORRUPT SNAPSHOT PARTLY LOADED" << endl;
+        remove(TEXT.c_str());
+        remove(SNAPSHOT.c_str());
+    }
+    return 0;
+}
 
-        switch (choice) {
-            case 1: {
-                string itemName;
-                int qty;
-                cout << "Enter item name: ";
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                getline(cin, itemName);
-                cout << "Enter quantity: ";
-                cin >> qty;
-                if (cin.fail() || qty <= 0) {
-                    cin.clear();
-                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << "Invalid quantity! Must be a positive integer." << endl;
-                    break;
-                }
-                try {
-                     bool onlySpaces = true;
-                        for (char c : itemName) {
-                            if (!isspace(c)) {
-                                onlySpaces = false;
-                                break;
-                            }
-                        }
-
-                        if (itemName.empty() || onlySpaces) {
-                            throw invalid_argument("Invalid item name! Cannot be empty or only spaces.");
-                        }
-                // Check validity (only letters and spaces allowed)
-                for (char c : itemName) {
-                    if (!isalpha(c) && !isspace(c)) {
-                        throw invalid_argument("Invalid item name! Only letters are allowed.");
-                    }
-                }
-                warehouse.addItem(itemName,qty);
+// The per-character check the prompts did before normalizeName: letters and
+// spaces only, not all spaces, through the locale-aware classifiers
+NameStatus perCharNameCheck(const char* name, size_t length) {
+    bool onlySpaces = true;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(name[i]);
+        if (!isalpha(c) && !isspace(c)) return NAME_BAD_CHAR;
+        if (!isspace(c)) onlySpaces = false;
+    }
+    return onlySpaces ? NAME_EMPTY : NAME_OK;
+}
 
-                } catch (const invalid_argument& e) {
-                    cout << e.what() << endl;
-                }
+// Bytes/s of normalizeName against the per-character check, over short
+// prompt-sized names and over 1 MiB inputs, both for input already in
+// canonical form and for mixed case with doubled spaces, which also runs
+// the compaction pass. Each pass starts from a fresh copy.
+int runNormalize(size_t totalBytes) {
+    const char* const WORDS[] = {"blue widget box large ", "Blue  Widget Box Large "};
+    for (int shape = 0; shape < 4; shape++) {
+        size_t length = shape % 2 == 0 ? 24 : 1 << 20;
+        string input;
+        while (input.size() < length) input += WORDS[shape / 2];
+        input.resize(length - 1);
+        input += 'x';
+        vector<char> buffer(length);
+        size_t passes = max<size_t>(totalBytes / length, 1);
+        double seconds[2];
+        size_t valid[2] = {0, 0};
+        for (int method = 0; method < 2; method++) {
+            auto started = chrono::steady_clock::now();
+            for (size_t i = 0; i < passes; i++) {
+                memcpy(buffer.data(), input.data(), length);
+                size_t n = length;
+                NameStatus status = method == 0 ? normalizeName(buffer.data(), n) : perCharNameCheck(buffer.data(), n);
+                valid[method] += status == NAME_OK;
+            }
+            seconds[method] = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        }
+        if (valid[0] != passes || valid[1] != passes) {
+            cout << "Name checks disagree on " << length << "-byte input" << endl;
+            return 1;
+        }
+        double bytes = static_cast<double>(passes) * length;
+        cout << length << "-byte " << (shape < 2 ? "canonical" : "uncompacted") << " names: normalizeName " << bytes / seconds[0] / 1e9 << " GB/s, per-char check "
+             << bytes / seconds[1] / 1e9 << " GB/s" << endl;
+    }
+    return 0;
+}
 
-                break;
+// Bulk import rate of a generated CSV receipts file, cold from disk, with
+// one worker and with one per core, against reading the same file line by
+// line into addItem
+int runImport(size_t rows) {
+    const string FILENAME = "import_bench.csv";
+    {
+        ofstream outfile(FILENAME, ios::binary);
+        outfile << "name,qty\n";
+        for (size_t i = 0; i < rows; i++) {
+            size_t n = i % 4096;
+            outfile << "receipt item " << static_cast<char>('a' + n % 26) << static_cast<char>('a' + n / 26 % 26)
+                    << static_cast<char>('a' + n / 676) << "," << 1 + i % 50 << "\n";
+        }
+    }
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    vector<unsigned> workers = {1};
+    if (cores > 1) workers.push_back(cores);
+    for (unsigned threads : workers) {
+        evictFromCache(FILENAME);
+        streambuf* saved = cout.rdbuf(nullptr);
+        ImportStats stats;
+        {
+            WarehouseSystem warehouse;
+            stats = warehouse.importReceipts(FILENAME, threads);
+        }
+        cout.rdbuf(saved);
+        cout.clear();
+        double seconds = max(stats.seconds, 1e-9);
+        cout << "importReceipts, " << threads << " worker(s): " << stats.rows << " rows, " << stats.rejected
+             << " rejected, " << static_cast<long long>(stats.rows / seconds) << " rows/s, "
+             << stats.bytes / seconds / 1e6 << " MB/s" << endl;
+    }
+
+    evictFromCache(FILENAME);
+    streambuf* saved = cout.rdbuf(nullptr);
+    size_t added = 0;
+    auto started = chrono::steady_clock::now();
+    {
+        WarehouseSystem warehouse;
+        ifstream infile(FILENAME);
+        string line;
+        getline(infile, line);  // header
+        while (getline(infile, line)) {
+            size_t comma = line.rfind(',');
+            string name = line.substr(0, comma);
+            NameStatus status = normalizeName(name);
+            if (status != NAME_OK) continue;
+            warehouse.addItem(name, stoi(line.substr(comma + 1)));
+            added++;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cout.rdbuf(saved);
+    cout.clear();
+    cout << "getline + addItem: " << added << " rows, " << static_cast<long long>(added / seconds) << " rows/s, "
+         << filesystem::file_size(FILENAME) / seconds / 1e6 << " MB/s" << endl;
+    remove(FILENAME.c_str());
+    return 0;
+}
+
+// Cost per appended journal record under several grouping and sync
+// policies. Policies that fsync every few records run a thousandth of the
+// records (at least 1000) so the run stays short.
+int runJournal(size_t records) {
+    const string FILENAME = "journal_bench.journal";
+    struct Case {
+        const char* label;
+        JournalPolicy policy;
+    };
+    const Case cases[] = {
+        {"write+fsync per record", JournalPolicy(1, 1 << 16, 1)},
+        {"write per record, no fsync", JournalPolicy(1, 1 << 16, 0)},
+        {"groups of 64, fsync each", JournalPolicy(64, 1 << 16, 1)},
+        {"groups of 1024, fsync each", JournalPolicy(1024, 1 << 20, 1)},
+        {"groups of 1024, no fsync", JournalPolicy(1024, 1 << 20, 0)},
+    };
+    for (const Case& c : cases) {
+        size_t n = records;
+        if (c.policy.syncEvery != 0 && c.policy.groupOps < 1024) n = max<size_t>(records / 1000, 1000);
+        remove(FILENAME.c_str());
+        auto started = chrono::steady_clock::now();
+        {
+            Journal journal;
+            journal.open(FILENAME, 1, c.policy);
+            for (size_t i = 0; i < n; i++) {
+                journal.record("A " + to_string(1 + i % 8) + " item " + to_string(i % 4096));
             }
-            case 2:
-                warehouse.processItem();
-                break;
-            case 3:
-                warehouse.shipItem();
-                break;
-            case 4:
-                warehouse.viewLastIncoming();
-                break;
-            case 5:
-                warehouse.viewNextShipment();
-                break;
-            case 6:
-                warehouse.viewAll();
-                break;
+        }  // closing flushes the last group
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        cout << c.label << ": " << n << " records, " << seconds * 1e9 / n << " ns/record" << endl;
+    }
+    remove(FILENAME.c_str());
+    return 0;
+}
 
-            case 7: {
-                if (warehouse.isEmpty()) {
-                    cout << "System is empty. No items to remove. Please add items first." << endl;
-                    break;
+// Checkpoint cost on a warehouse of each size, half its entries in
+// inventory and half in shipping: the one-off start of the writer thread,
+// then over a few rounds of journaled operations the pause checkpointIfDue
+// causes in the caller and the time the writer takes in the background.
+// Each checkpoint text file must match a save of the live warehouse.
+int runCheckpoint(const vector<size_t>& sizes) {
+    const string TEXT = "checkpoint_bench.txt";
+    const string SNAPSHOT = "checkpoint_bench.snap";
+    const string JOURNAL = "checkpoint_bench.journal";
+    const string LIVE = "checkpoint_bench.live.txt";
+    const int ROUNDS = 5;
+    vector<string> names;
+    for (size_t i = 0; i < 4096; i++) {
+        names.push_back("item " + string(1, static_cast<char>('a' + i % 26)) + string(1, static_cast<char>('a' + i / 26 % 26))
+                        + string(1, static_cast<char>('a' + i / 676)));
+    }
+    for (size_t entries : sizes) {
+        remove(JOURNAL.c_str());
+        streambuf* saved = cout.rdbuf(nullptr);
+        double startSeconds = 0;
+        double maxPause = 0;
+        double totalPause = 0;
+        double totalWrite = 0;
+        bool matches = true;
+        {
+            WarehouseSystem warehouse;
+            for (size_t i = 0; i < entries; i++) {
+                // Neighbours differ, so no entries merge
+                warehouse.addItem(names[i % names.size()], 1 + static_cast<int>(i % 8));
+            }
+            warehouse.processN(static_cast<long long>(entries / 2) * 4);
+            warehouse.openJournal(JOURNAL);
+            auto started = chrono::steady_clock::now();
+            warehouse.enableCheckpoints(TEXT, SNAPSHOT, chrono::steady_clock::duration::zero());
+            startSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            for (int round = 0; round < ROUNDS; round++) {
+                for (int i = 0; i < 1000; i++) {
+                    warehouse.addItem(names[(round * 1000 + i) % names.size()], 1 + i % 8);
                 }
-                string name;
-                cout << "Enter item name to remove: ";
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                getline(cin, name);
+                warehouse.processN(2000);
+                warehouse.shipBatch(1000);
+                started = chrono::steady_clock::now();
+                warehouse.checkpointIfDue();
+                auto handedOff = chrono::steady_clock::now();
+                warehouse.finishCheckpoint();
+                double pause = chrono::duration<double>(handedOff - started).count();
+                maxPause = max(maxPause, pause);
+                totalPause += pause;
+                totalWrite += chrono::duration<double>(chrono::steady_clock::now() - handedOff).count();
+                warehouse.saveToFile(LIVE);
+                ifstream checkpoint(TEXT, ios::binary);
+                ifstream live(LIVE, ios::binary);
+                matches = matches && equal(istreambuf_iterator<char>(checkpoint), istreambuf_iterator<char>(),
+                                           istreambuf_iterator<char>(live), istreambuf_iterator<char>());
+            }
+        }
+        cout.rdbuf(saved);
+        cout.clear();
+        cout << entries << " entries: writer started in " << startSeconds * 1e3 << " ms, checkpoint pause "
+             << totalPause * 1e6 / ROUNDS << " us (max " << maxPause * 1e6 << " us), background write "
+             << totalWrite * 1e3 / ROUNDS << " ms" << endl;
+        if (!matches) cout << "CHECKPOINT DIFFERS FROM LIVE STATE" << endl;
+        for (const string& filename : {TEXT, SNAPSHOT, JOURNAL, LIVE}) {
+            remove(filename.c_str());
+        }
+    }
+    return 0;
+}
 
-                try {
-                    bool onlySpaces = true;
-                    for (char c : name) {
-                        if (!isspace(c)) {
-                            onlySpaces = false;
-                            break;
-                        }
+// Mixed add/process/ship throughput of ConcurrentWarehouse from 1 to 64
+// threads; one operation in 20 is a search or a count
+int runScaling(size_t opsPerThread) {
+    vector<string> names;
+    for (char a = 'a'; a <= 'p'; a++) {
+        for (char b = 'a'; b <= 'p'; b++) {
+            names.push_back(string("item ") + a + b);
+        }
+    }
+    for (unsigned threads = 1; threads <= 64; threads *= 2) {
+        ConcurrentWarehouse warehouse;
+        atomic<bool> go{false};
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                mt19937 rng(t + 1);
+                while (!go.load(memory_order_acquire)) this_thread::yield();
+                for (size_t i = 0; i < opsPerThread; i++) {
+                    unsigned pick = rng() % 20;
+                    if (pick < 9) {
+                        warehouse.addItem(names[rng() % names.size()], 1 + rng() % 3);
+                    } else if (pick < 15) {
+                        warehouse.processItem();
+                    } else if (pick < 19) {
+                        warehouse.shipItem();
+                    } else {
+                        warehouse.totalUnits();
                     }
+                }
+            });
+        }
+        auto started = chrono::steady_clock::now();
+        go.store(true, memory_order_release);
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        cout << threads << " thread(s): " << static_cast<long long>(threads * opsPerThread / seconds)
+             << " ops/s" << endl;
+    }
+    return 0;
+}
 
-                    if (name.empty() || onlySpaces) {
-                        throw invalid_argument("Invalid item name! Cannot be empty or only spaces.");
-                    }
+// ShippingQueue behind one mutex, the baseline for runMpmc
+class LockedShippingQueue {
+private:
+    mutex lock;
+    NodePool pool;
+    ShippingQueue queue;
 
-                for (char c : name) {
-                    if (!isalpha(c) && !isspace(c)) {
-                        throw invalid_argument("Invalid item name! Only letters are allowed.");
-                    }
-                }
+public:
+    LockedShippingQueue() : queue(pool) {}
 
-                warehouse.removeItem(name);
+    void enqueue(uint32_t itemId, int qty) {
+        lock_guard<mutex> hold(lock);
+        queue.enqueue(itemId, qty);
+    }
 
-            } catch (const invalid_argument& e) {
-                cout << e.what() << endl;
-            }
+    // Up to n units off the front entry in one step, as the lock-free queue does
+    int dequeueUpTo(int n, uint32_t& itemId) {
+        lock_guard<mutex> hold(lock);
+        if (queue.isEmpty()) return 0;
+        itemId = queue.peek();
+        int taken = min(n, queue.quantityOf(itemId));
+        queue.take(itemId, taken);
+        return taken;
+    }
+};
 
-            break;
+// Producers and consumers in equal numbers move the same units through a
+// queue; returns units per second and checks every unit arrived once
+template <typename Queue>
+double mpmcRun(unsigned pairs, size_t entriesPerProducer, bool& intact) {
+    Queue queue;
+    atomic<bool> go{false};
+    atomic<long long> consumed{0};
+    atomic<unsigned long long> consumedSum{0};
+    long long total = 0;
+    unsigned long long expectedSum = 0;
+    for (unsigned p = 0; p < pairs; p++) {
+        for (size_t i = 0; i < entriesPerProducer; i++) {
+            int qty = 1 + static_cast<int>(i % 4);
+            total += qty;
+            expectedSum += static_cast<unsigned long long>(p * entriesPerProducer + i) * qty;
         }
+    }
 
-            case 8: {
-                if (warehouse.isEmpty()) {
-                    cout << "System is empty. Please add items first before searching." << endl;
-                    break;
+    vector<thread> workers;
+    for (unsigned p = 0; p < pairs; p++) {
+        workers.emplace_back([&, p] {
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            for (size_t i = 0; i < entriesPerProducer; i++) {
+                queue.enqueue(static_cast<uint32_t>(p * entriesPerProducer + i), 1 + static_cast<int>(i % 4));
+            }
+        });
+        workers.emplace_back([&, p] {
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            unsigned long long sum = 0;
+            unsigned round = p;
+            while (consumed.load(memory_order_relaxed) < total) {
+                uint32_t itemId = 0;
+                // Every eighth call is a batch of up to 8 units
+                int qty = queue.dequeueUpTo(++round % 8 == 0 ? 8 : 1, itemId);
+                if (qty == 0) {
+                    this_thread::yield();
+                    continue;
                 }
-                string searchName;
-                cout << "Enter item name to search: ";
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                getline(cin, searchName);
-                warehouse.searchItem(searchName);
-                break;
+                sum += static_cast<unsigned long long>(itemId) * qty;
+                consumed.fetch_add(qty, memory_order_relaxed);
             }
+            consumedSum.fetch_add(sum, memory_order_relaxed);
+        });
+    }
+    auto started = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    intact = consumed.load() == total && consumedSum.load() == expectedSum;
+    return total / seconds;
+}
+
+// Lock-free queue against the mutex baseline at 1 to 16 producer/consumer
+// pairs; each run also checks that every unit came out exactly once
+int runMpmc(size_t entriesPerProducer) {
+    bool allIntact = true;
+    for (unsigned pairs = 1; pairs <= 16; pairs *= 2) {
+        bool lockFreeIntact;
+        bool lockedIntact;
+        double lockFree = mpmcRun<LockFreeShippingQueue>(pairs, entriesPerProducer, lockFreeIntact);
+        double locked = mpmcRun<LockedShippingQueue>(pairs, entriesPerProducer, lockedIntact);
+        cout << pairs << " producer(s) + " << pairs << " consumer(s): lock-free "
+             << static_cast<long long>(lockFree) << " units/s, mutex " << static_cast<long long>(locked)
+             << " units/s" << (lockFreeIntact && lockedIntact ? "" : "  UNITS LOST OR DUPLICATED") << endl;
+        allIntact = allIntact && lockFreeIntact && lockedIntact;
+    }
+    return allIntact ? 0 : 1;
+}
 
+// InventoryStack behind one mutex, the baseline for runTreiber
+class LockedInventoryStack {
+private:
+    mutex lock;
+    NodePool pool;
+    InventoryStack stack;
 
-            case 9: {
-                    if (warehouse.isEmpty()) {
-                    cout << "System is empty. Total items: 0" << endl;
-                    break;
+public:
+    LockedInventoryStack() : stack(pool) {}
+
+    void push(uint32_t itemId, int qty = 1) {
+        lock_guard<mutex> hold(lock);
+        stack.push(itemId, qty);
+    }
+
+    bool pop(uint32_t& itemId) {
+        lock_guard<mutex> hold(lock);
+        if (stack.isEmpty()) return false;
+        itemId = stack.pop();
+        return true;
+    }
+};
+
+// Threads push and pop single units at random in the given proportion;
+// returns operations per second and checks, by draining the stack at the
+// end, that every unit pushed was popped exactly once
+template <typename Stack>
+double treiberRun(unsigned threads, int pushPercent, size_t opsPerThread, bool& intact) {
+    Stack stack;
+    atomic<bool> go{false};
+    atomic<long long> balance{0};              // units pushed minus units popped
+    atomic<unsigned long long> idBalance{0};   // same, weighted by item id (mod 2^64)
+
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            mt19937 rng(t + 1);
+            long long units = 0;
+            unsigned long long ids = 0;
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            for (size_t i = 0; i < opsPerThread; i++) {
+                if (static_cast<int>(rng() % 100) < pushPercent) {
+                    uint32_t itemId = rng() % 4;  // few items, so pushes often merge
+                    stack.push(itemId);
+                    units++;
+                    ids += itemId;
+                } else {
+                    uint32_t itemId;
+                    if (stack.pop(itemId)) {
+                        units--;
+                        ids -= itemId;
+                    }
                 }
-                warehouse.countItems();
-                break;
             }
+            balance.fetch_add(units, memory_order_relaxed);
+            idBalance.fetch_add(ids, memory_order_relaxed);
+        });
+    }
+    auto started = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
 
-            case 10:
-                cout << "Exiting Warehouse System. Goodbye!" << endl;
-                warehouse.saveToFile("result.txt");
-                break;
+    long long left = 0;
+    unsigned long long leftIds = 0;
+    uint32_t itemId;
+    while (stack.pop(itemId)) {
+        left++;
+        leftIds += itemId;
+    }
+    intact = left == balance.load() && leftIds == idBalance.load();
+    return threads * opsPerThread / seconds;
+}
 
-            default:
-                cout << "Invalid choice! Please try again." << endl;
+// Lock-free stack against the mutex baseline at 2 to 64 threads and
+// 25/50/75% pushes; each run also checks that no unit was lost or duplicated
+int runTreiber(size_t opsPerThread) {
+    bool allIntact = true;
+    for (int pushPercent : {25, 50, 75}) {
+        for (unsigned threads = 2; threads <= 64; threads *= 2) {
+            bool lockFreeIntact;
+            bool lockedIntact;
+            double lockFree = treiberRun<LockFreeInventoryStack>(threads, pushPercent, opsPerThread, lockFreeIntact);
+            double locked = treiberRun<LockedInventoryStack>(threads, pushPercent, opsPerThread, lockedIntact);
+            cout << threads << " threads, " << pushPercent << "% pushes: lock-free "
+                 << static_cast<long long>(lockFree) << " ops/s, mutex " << static_cast<long long>(locked)
+                 << " ops/s" << (lockFreeIntact && lockedIntact ? "" : "  UNITS LOST OR DUPLICATED") << endl;
+            allIntact = allIntact && lockFreeIntact && lockedIntact;
+        }
+    }
+    return allIntact ? 0 : 1;
+}
+
+// Append a run, merging it into the previous one for the same item
+static void appendRun(vector<ManifestLine>& runs, uint32_t itemId, long long quantity) {
+    if (!runs.empty() && runs.back().itemId == itemId) {
+        runs.back().quantity += quantity;
+    } else {
+        runs.push_back({itemId, quantity});
+    }
+}
+
+// Push units through a ProcessingPipeline in receipt batches; prints
+// end-to-end units/s, the depth at each stage boundary sampled while it
+// runs, whether held and malformed units were all kept out, and whether
+// the shipping queue came out in pick order
+int runPipeline(long long totalUnits, unsigned threads) {
+    const size_t RECEIPT_LINES = 64;
+    const uint32_t ITEMS = 1000;
+    vector<uint32_t> ids;
+    for (uint32_t i = 0; i < ITEMS; i++) {
+        ids.push_back(skuDictionary().intern("item" + to_string(i)));
+    }
+
+    // Every hundredth item is on hold; one receipt line in 1000 is malformed
+    vector<uint32_t> holds;
+    for (uint32_t i = 99; i < ITEMS; i += 100) {
+        holds.push_back(ids[i]);
+    }
+
+    mutex pickLogLock;
+    vector<vector<ManifestLine>> pickLog;  // by batch number
+    WorkStealingPool pool(threads);
+    ProcessingPipeline pipeline(pool, [&](const PickBatch& batch) {
+        lock_guard<mutex> hold(pickLogLock);
+        if (pickLog.size() <= batch.seq) pickLog.resize(batch.seq + 1);
+        pickLog[batch.seq] = batch.lines;
+    }, holds);
+    const ProcessingPipeline::Counters& counters = pipeline.stageCounters();
+
+    // Sample depth at each stage boundary while the pipeline runs
+    atomic<bool> running{true};
+    long long samples = 0;
+    long long sumInventory = 0, sumInFlight = 0, sumTasks = 0;
+    long long peakInventory = 0, peakInFlight = 0, peakTasks = 0;
+    thread monitor([&] {
+        while (running.load()) {
+            long long received = counters.received.load();
+            long long picked = counters.picked.load();
+            long long shipped = counters.shipped.load();
+            long long inventory = received - picked;
+            long long inFlight = picked - shipped - counters.rejected.load();
+            long long tasks = static_cast<long long>(pool.backlog());
+            samples++;
+            sumInventory += inventory;
+            sumInFlight += inFlight;
+            sumTasks += tasks;
+            peakInventory = max(peakInventory, inventory);
+            peakInFlight = max(peakInFlight, inFlight);
+            peakTasks = max(peakTasks, tasks);
+            this_thread::sleep_for(chrono::milliseconds(5));
         }
-    } while (choice != 10);
+    });
+
+    mt19937 rng(1);
+    auto started = chrono::steady_clock::now();
+    long long submitted = 0;
+    long long held = 0;
+    long long malformed = 0;
+    while (submitted < totalUnits) {
+        vector<ManifestLine> lines;
+        for (size_t i = 0; i < RECEIPT_LINES && submitted < totalUnits; i++) {
+            long long qty = min<long long>(1 + rng() % 8, totalUnits - submitted);
+            uint32_t item = rng() % ITEMS;
+            if (rng() % 1000 == 0) {
+                lines.push_back({SkuDictionary::NO_ID, qty});
+                malformed += qty;
+            } else {
+                lines.push_back({ids[item], qty});
+                if (item % 100 == 99) held += qty;
+            }
+            submitted += qty;
+        }
+        pipeline.receive(move(lines));
+    }
+    pipeline.drain();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    running.store(false);
+    monitor.join();
+
+    // The queue must hold the picked batches back to back in pick order
+    vector<ManifestLine> expected;
+    for (const vector<ManifestLine>& batch : pickLog) {
+        for (const ManifestLine& line : batch) {
+            appendRun(expected, line.itemId, line.quantity);
+        }
+    }
+    vector<ManifestLine> actual;
+    for (const auto& entry : pipeline.shippingQueue()) {
+        appendRun(actual, entry.itemId, entry.quantity);
+    }
+    bool ordered = expected.size() == actual.size()
+                   && equal(expected.begin(), expected.end(), actual.begin(),
+                            [](const ManifestLine& a, const ManifestLine& b) {
+                                return a.itemId == b.itemId && a.quantity == b.quantity;
+                            });
+    bool intact = counters.shipped.load() == totalUnits - held - malformed && counters.rejected.load() == held
+                  && counters.refused.load() == malformed && pipeline.heldBack() == 0;
+
+    cout << totalUnits << " units through " << pool.size() << " worker(s) in " << seconds << " s: "
+         << static_cast<long long>(totalUnits / seconds) << " units/s end to end" << endl;
+    if (samples > 0) {
+        cout << "Stage depth (mean / peak): inventory " << sumInventory / samples << " / " << peakInventory
+             << " units, processing " << sumInFlight / samples << " / " << peakInFlight
+             << " units, task deques " << sumTasks / samples << " / " << peakTasks << endl;
+    }
+    cout << "Shipped " << counters.shipped.load() << ", held " << counters.rejected.load() << ", refused "
+         << counters.refused.load() << (intact ? "" : "  UNITS LOST") << (ordered ? ", FIFO matches pick order" : ", OUT OF PICK ORDER")
+         << endl;
+    return intact && ordered ? 0 : 1;
+}
+
+// PriorityShippingQueue against the plain ShippingQueue: fill with
+// `entries` single-unit entries, run a steady enqueue/dequeue mix at that
+// depth, then drain; checks the priority queue hands out class, deadline,
+// arrival order
+int runPriority(size_t entries) {
+    const size_t MIXED_OPS = 2000000;
+    vector<uint32_t> items(1 << 16);
+    vector<uint32_t> deadlines(items.size());
+    vector<ShipClass> classes(items.size());
+    mt19937 rng(1);
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i] = rng() % 100000;
+        deadlines[i] = rng() % 1000;
+        unsigned pick = rng() % 10;
+        classes[i] = pick < 2 ? SHIP_EXPRESS : pick < 7 ? SHIP_STANDARD : SHIP_ECONOMY;
+    }
+    size_t mask = items.size() - 1;
+    auto seconds = [](chrono::steady_clock::time_point since) {
+        return chrono::duration<double>(chrono::steady_clock::now() - since).count();
+    };
+    auto report = [](const char* name, const char* phase, size_t ops, double s) {
+        cout << "  " << name << " " << phase << ": " << s * 1e9 / max<size_t>(ops, 1) << " ns/op" << endl;
+    };
+
+    {
+        NodePool pool;
+        ShippingQueue queue(pool);
+        auto started = chrono::steady_clock::now();
+        for (size_t i = 0; i < entries; i++) {
+            // Alternate items so that entries are not merged
+            queue.enqueue(items[i & mask] * 2 + (i & 1));
+        }
+        report("plain FIFO", "fill", entries, seconds(started));
+        started = chrono::steady_clock::now();
+        for (size_t i = 0; i < MIXED_OPS; i++) {
+            queue.enqueue(items[i & mask] * 2 + (i & 1));
+            queue.dequeue();
+        }
+        report("plain FIFO", "enqueue+dequeue", MIXED_OPS, seconds(started));
+        started = chrono::steady_clock::now();
+        while (!queue.isEmpty()) {
+            queue.dequeue();
+        }
+        report("plain FIFO", "drain", entries, seconds(started));
+    }
+
+    PriorityShippingQueue queue;
+    auto started = chrono::steady_clock::now();
+    for (size_t i = 0; i < entries; i++) {
+        queue.enqueue(items[i & mask], 1, classes[i & mask], deadlines[i & mask]);
+    }
+    report("priority heap", "fill", entries, seconds(started));
+    started = chrono::steady_clock::now();
+    for (size_t i = 0; i < MIXED_OPS; i++) {
+        queue.enqueue(items[i & mask], 1, classes[i & mask], deadlines[i & mask]);
+        queue.dequeue();
+    }
+    report("priority heap", "enqueue+dequeue", MIXED_OPS, seconds(started));
+
+    // Drain a fresh queue and check the order against the inputs
+    queue.clear();
+    for (size_t i = 0; i < entries; i++) {
+        queue.enqueue(static_cast<uint32_t>(i), 1, classes[i & mask], deadlines[i & mask]);
+    }
+    started = chrono::steady_clock::now();
+    vector<uint32_t> order;
+    order.reserve(entries);
+    while (!queue.isEmpty()) {
+        order.push_back(queue.dequeue());
+    }
+    report("priority heap", "drain", entries, seconds(started));
+    bool ordered = true;
+    for (size_t i = 1; i < order.size() && ordered; i++) {
+        auto rank = [&](uint32_t n) {
+            return make_tuple(classes[n & mask], deadlines[n & mask], n);
+        };
+        ordered = rank(order[i - 1]) < rank(order[i]);
+    }
+    cout << entries << " pending entries: " << (ordered ? "priority order ok" : "PRIORITY ORDER BROKEN") << endl;
+    return ordered ? 0 : 1;
+}
+
+#ifdef __linux__
+// Run one request for runServer; its output becomes the response text
+bool executeRequest(WarehouseSystem& warehouse, ServerOp op, int64_t number, const string& name) {
+    switch (op) {
+        case OP_ADD:
+            if (number <= 0 || number > numeric_limits<int>::max()) {
+                throw invalid_argument("Invalid quantity! Must be a positive integer.");
+            }
+            warehouse.addItem(checkedItemName(name), static_cast<int>(number));
+            return true;
+        case OP_PROCESS:
+            // number 0 processes the top entry, as menu option 2 does
+            if (number < 0) throw invalid_argument("Invalid number! Must be a positive integer.");
+            if (number == 0) {
+                warehouse.processItem();
+            } else {
+                warehouse.processN(number);
+            }
+            return true;
+        case OP_SHIP: {
+            if (number < 0) throw invalid_argument("Invalid number! Must be a positive integer.");
+            if (number == 0) {
+                warehouse.shipItem();
+                return true;
+            }
+            long long shipped = 0;
+            vector<ManifestLine> manifest = warehouse.shipBatch(number);
+            for (const ManifestLine& line : manifest) {
+                shipped += line.quantity;
+            }
+            cout << "Shipped " << shipped << " item(s) in " << manifest.size() << " line(s)." << endl;
+            return true;
+        }
+        case OP_SEARCH:
+            warehouse.searchItem(checkedItemName(name));
+            return true;
+        case OP_COUNT:
+            warehouse.countItems();
+            return true;
+        case OP_SNAPSHOT:
+            warehouse.finishCheckpoint();
+            warehouse.saveToFile("result.txt");
+            warehouse.saveSnapshot("result.snap");
+            warehouse.resetJournal();
+            return true;
+    }
+    cout << "Unknown request " << static_cast<int>(op) << endl;
+    return false;
 }
+#endif
 
-int main() {
+// warehouse                     interactive menu
+// Options before the mode, for the menu, --batch and --serve:
+//   --docks <n>                   ship from n dock queues (default 1)
+//   --dock-policy <policy>        round-robin, least-loaded or sku
+//   --shipping <mode>             fifo or priority (default: as saved)
+// warehouse --batch [file]      run commands from file (default stdin)
+// warehouse --serve <address>   serve a socket path or localhost TCP port
+// warehouse --loadgen <address> [connections] [requests] [pipeline]
+// warehouse --lookup [max items]   name lookup latency from 1k items up
+// warehouse --churn [ops]       node pool against new/delete
+// warehouse --scan [entries]    shipping queue scans/s for this build's backend
+// warehouse --ship [units]      shipBatch against one shipItem per unit
+// warehouse --teardown [entries]   teardown time against unit count
+// warehouse --coldstart [entries]   text against snapshot startup (1M, 50M)
+// warehouse --normalize [bytes]   name check throughput (256 MB per case)
+// warehouse --import [rows]   bulk receipts import rate (2M rows)
+// warehouse --journal [records]   journal append cost per policy
+// warehouse --checkpoint [entries]   checkpoint pause and write time (1M, 50M)
+// warehouse --scale [ops per thread]   concurrent variant scaling run
+// warehouse --mpmc [entries per producer]   lock-free queue vs mutex
+// warehouse --treiber [ops per thread]   lock-free stack vs mutex
+// warehouse --pipeline [units] [threads]   work-stealing processing pipeline
+// warehouse --priority [entries]   priority shipping heap vs plain queue
+int main(int argc, char* argv[]) {
+    while (argc >= 3) {
+        string option = argv[1];
+        if (option == "--docks") {
+            long long count = 0;
+            if (!parseCount(argv[2], count) || static_cast<size_t>(count) > MAX_DOCKS) {
+                cerr << "--docks takes a number from 1 to " << MAX_DOCKS << endl;
+                return 1;
+            }
+            startupDocks.count = static_cast<size_t>(count);
+        } else if (option == "--dock-policy") {
+            if (!parseDockPolicy(argv[2], startupDocks.policy)) {
+                cerr << "Unknown dock policy " << argv[2] << " (round-robin, least-loaded, sku)" << endl;
+                return 1;
+            }
+        } else if (option == "--shipping") {
+            string shipping = argv[2];
+            if (shipping != "fifo" && shipping != "priority") {
+                cerr << "Unknown shipping mode " << shipping << " (fifo, priority)" << endl;
+                return 1;
+            }
+            startupDocks.priorityShipping = shipping == "priority" ? 1 : 0;
+        } else {
+            break;
+        }
+        // Drop the option; argv[0] is not used past this point
+        argc -= 2;
+        argv += 2;
+    }
+    string mode = argc >= 2 ? argv[1] : "";
+    if (mode == "--batch") {
+        return runBatch(argc >= 3 ? argv[2] : "-");
+    }
+    if (mode == "--lookup") {
+        size_t items = 10000000;
+        if (!countArgument(argc, argv, 2, items)) return usage("--lookup [max items]");
+        return runLookup(items);
+    }
+    if (mode == "--churn") {
+        size_t ops = 10000000;
+        if (!countArgument(argc, argv, 2, ops)) return usage("--churn [ops]");
+        return runChurn(ops);
+    }
+    if (mode == "--scan") {
+        size_t entries = 1000000;
+        if (!countArgument(argc, argv, 2, entries)) return usage("--scan [entries]");
+        return runScan(entries);
+    }
+    if (mode == "--ship") {
+        size_t units = 1000000;
+        if (!countArgument(argc, argv, 2, units)) return usage("--ship [units]");
+        return runShipping(static_cast<long long>(units));
+    }
+    if (mode == "--teardown") {
+        size_t entries = 1000000;
+        if (!countArgument(argc, argv, 2, entries)) return usage("--teardown [entries]");
+        return runTeardown(entries);
+    }
+    if (mode == "--coldstart") {
+        size_t entries = 0;
+        if (!countArgument(argc, argv, 2, entries)) return usage("--coldstart [entries]");
+        return runColdStart(entries != 0 ? vector<size_t>{entries} : vector<size_t>{1000000, 50000000});
+    }
+    if (mode == "--normalize") {
+        size_t bytes = 256 << 20;
+        if (!countArgument(argc, argv, 2, bytes)) return usage("--normalize [bytes]");
+        return runNormalize(bytes);
+    }
+    if (mode == "--import") {
+        size_t rows = 2000000;
+        if (!countArgument(argc, argv, 2, rows)) return usage("--import [rows]");
+        return runImport(rows);
+    }
+    if (mode == "--journal") {
+        size_t records = 1000000;
+        if (!countArgument(argc, argv, 2, records)) return usage("--journal [records]");
+        return runJournal(records);
+    }
+    if (mode == "--checkpoint") {
+        size_t entries = 0;
+        if (!countArgument(argc, argv, 2, entries)) return usage("--checkpoint [entries]");
+        return runCheckpoint(entries != 0 ? vector<size_t>{entries} : vector<size_t>{1000000, 50000000});
+    }
+    if (mode == "--scale") {
+        size_t ops = 200000;
+        if (!countArgument(argc, argv, 2, ops)) return usage("--scale [ops per thread]");
+        return runScaling(ops);
+    }
+    if (mode == "--mpmc") {
+        size_t entries = 200000;
+        if (!countArgument(argc, argv, 2, entries)) return usage("--mpmc [entries per producer]");
+        return runMpmc(entries);
+    }
+    if (mode == "--treiber") {
+        size_t ops = 200000;
+        if (!countArgument(argc, argv, 2, ops)) return usage("--treiber [ops per thread]");
+        return runTreiber(ops);
+    }
+    if (mode == "--priority") {
+        size_t entries = 2000000;
+        if (!countArgument(argc, argv, 2, entries)) return usage("--priority [entries]");
+        return runPriority(entries);
+    }
+    if (mode == "--pipeline") {
+        size_t units = 2000000;
+        size_t threads = max(thread::hardware_concurrency(), 1u);
+        if (!countArgument(argc, argv, 2, units) || !countArgument(argc, argv, 3, threads)) {
+            return usage("--pipeline [units] [threads]");
+        }
+        return runPipeline(static_cast<long long>(units), static_cast<unsigned>(threads));
+    }
+#ifdef __linux__
+    if (mode == "--serve") {
+        if (!addressArgument(argc, argv, 2)) return usage("--serve <address>");
+        return runServer<WarehouseSystem>(argv[2]);
+    }
+    if (mode == "--loadgen") {
+        size_t connections = 4;
+        size_t requests = 100000;
+        size_t pipeline = 16;
+        if (!addressArgument(argc, argv, 2) || !countArgument(argc, argv, 3, connections)
+                || !countArgument(argc, argv, 4, requests) || !countArgument(argc, argv, 5, pipeline)) {
+            return usage("--loadgen <address> [connections] [requests] [pipeline]");
+        }
+        return runLoadgen(argv[2], connections, requests, pipeline);
+    }
+#endif
     runWarehouseSystem();
 
     return 0;
@@ -1,196 +1,363 @@
-#include <iostream>
-#include <string>
-#include <limits>
-#include <stdexcept>
-#include <fstream>
-using namespace std;
-
-// Node for Stack and Queue
-struct ItemNode {
-    string itemName;
-    ItemNode* next;
-    int quantity;
+#include "warehouse_common.h"
 
-    ItemNode(string name,int qty = 1) : itemName(name),quantity(qty), next(nullptr) {}
+// One line of a customer order
+struct OrderLine {
+    string name;
+    int quantity;
 };
 
-// Stack class for incoming items (LIFO)
-class InventoryStack {
+// Warehouse System
+class WarehouseSystem {
 private:
-    ItemNode* top;
+    NodePool pool;  // declared first so it outlives both containers
+    InventoryStack inventory;
+    ShippingQueue shipping;
+    Journal journal;
+    uint64_t snapshotGeneration;  // journal position covered by the loaded snapshot
+    uint64_t snapshotOffset;
+
+    // Background checkpoints, see checkpointIfDue
+    string checkpointText;        // empty while checkpoints are off
+    string checkpointSnapshot;
+    chrono::steady_clock::duration checkpointInterval;
+    chrono::steady_clock::time_point lastCheckpoint;
+    uint64_t checkpointGeneration;  // journal position the latest checkpoint covers
+    uint64_t checkpointOffset;
+    string journalTail;           // records journaled since the latest checkpoint began
+    CheckpointWriter<WarehouseSystem> checkpoints;
+
+    // Move qty units of the topmost entry for itemId to the shipping rear
+    void moveToShipping(uint32_t itemId, int qty) {
+#if !defined(WAREHOUSE_VECTOR_STACK) && !defined(WAREHOUSE_RING_QUEUE)
+        if (inventory.quantityOf(itemId) == qty) {
+            // Both sides are lists over the same pool: relink the node itself
+            shipping.enqueueNode(inventory.detach(itemId));
+            return;
+        }
+#endif
+        inventory.take(itemId, qty);
+        shipping.enqueue(itemId, qty);
+    }
 
-public:
+    vector<long long> orderDemand;  // per item id, units asked for by the order being checked
 
-    ItemNode* getTop() const { return top; }
+    // Merge an order's lines into one per item, in first-seen order, and
+    // check each against the inventory index by the same rule processItem
+    // uses. Nothing is moved; on failure reason names the line that fell short.
+    bool checkOrder(const vector<OrderLine>& lines, vector<pair<uint32_t, int>>& merged, string& reason) {
+        merged.clear();
+        if (lines.empty()) {
+            reason = "Order has no lines.";
+            return false;
+        }
+        orderDemand.resize(skuDictionary().size(), 0);
+        bool ok = true;
+        for (const OrderLine& line : lines) {
+            uint32_t id = skuDictionary().lookup(line.name);
+            if (id == SkuDictionary::NO_ID || line.quantity <= 0) {
+                reason = line.quantity <= 0 ? "Invalid quantity for \"" + line.name + "\"."
+                                            : "Item not found in inventory: " + line.name;
+                ok = false;
+                break;
+            }
+            if (orderDemand[id] == 0) merged.push_back({id, 0});
+            orderDemand[id] += line.quantity;
+        }
+        // Reset the scratch totals even after a failure
+        for (auto& item : merged) {
+            long long demand = orderDemand[item.first];
+            orderDemand[item.first] = 0;
+            if (!ok) continue;
+            int stocked = inventory.quantityOf(item.first);
+            if (stocked < demand) {
+                const string& name = skuDictionary().name(item.first);
+                reason = stocked == 0 ? "Item not found in inventory: " + name
+                                      : "Not enough \"" + name + "\" in inventory (" + to_string(demand)
+                                        + " ordered, " + to_string(stocked) + " available).";
+                ok = false;
+                continue;
+            }
+            item.second = static_cast<int>(demand);
+        }
+        return ok;
+    }
 
-    void setTop(ItemNode* node) { top = node; }
+    // Write the text save to a temporary file and swap it in
+    void writeTextFile(const string& filename) const {
+        string tmp = filename + ".tmp";
+        ofstream outfile(tmp);
+        if (!outfile) {
+            throw runtime_error("Error: Could not open file for writing!");
+        }
 
-    InventoryStack() : top(nullptr) {}
+        outfile << TEXT_SAVE_HEADER << '\n';
+        outfile << "--- Final Inventory ---" << '\n';
+        if (inventory.isEmpty()) {
+            outfile << "Inventory is empty." << '\n';
+        } else {
+            for (const auto& entry : inventory) {
+                outfile << entry.quantity << '\t' << skuDictionary().name(entry.itemId) << '\n';
+            }
+        }
 
-    ~InventoryStack() {
-        while (!isEmpty()) {
-            pop();
+        outfile << "--- Final Shipping Queue ---" << '\n';
+        if (shipping.isEmpty()) {
+            outfile << "Shipping queue is empty." << '\n';
+        } else {
+            for (const auto& entry : shipping) {
+                outfile << entry.quantity << '\t' << skuDictionary().name(entry.itemId) << '\n';
+            }
         }
-    }
 
-    bool isEmpty() const {
-        return top == nullptr;
+        outfile.close();
+        if (!outfile) {
+            throw runtime_error("Error: Could not write " + tmp);
+        }
+        commitFile(tmp, filename);
     }
 
-    void push(string itemName, int qty = 1)
-    {
-        if (!isEmpty() && top->itemName == itemName)
-        {
-            top->quantity += qty;
-            return;
+    // Both containers as a binary snapshot (see SnapshotHeader), recording
+    // the journal position
+    string snapshotImage() const {
+        vector<uint32_t> localIds(skuDictionary().size(), SkuDictionary::NO_ID);
+        vector<uint32_t> usedIds;
+        vector<SnapshotRecord> records;
+        records.reserve(inventory.entryCount() + shipping.entryCount());
+
+        for (const auto& entry : inventory) {
+            if (localIds[entry.itemId] == SkuDictionary::NO_ID) {
+                localIds[entry.itemId] = static_cast<uint32_t>(usedIds.size());
+                usedIds.push_back(entry.itemId);
+            }
+            records.push_back({localIds[entry.itemId], entry.quantity});
+        }
+        for (const auto& entry : shipping) {
+            if (localIds[entry.itemId] == SkuDictionary::NO_ID) {
+                localIds[entry.itemId] = static_cast<uint32_t>(usedIds.size());
+                usedIds.push_back(entry.itemId);
+            }
+            records.push_back({localIds[entry.itemId], entry.quantity});
+        }
 
+        SnapshotHeader header = SnapshotHeader();
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.nameCount = static_cast<uint32_t>(usedIds.size());
+        header.nameBytes = 0;
+        header.stackCount = inventory.entryCount();
+        header.queueCount = shipping.entryCount();
+        header.journalGeneration = journal.isOpen() ? journal.generation() : snapshotGeneration;
+        header.journalOffset = journal.isOpen() ? journal.size() : snapshotOffset;
+        header.dockCount = 1;
+        uint64_t queueCount = header.queueCount;
+
+        vector<uint64_t> offsets;
+        offsets.reserve(usedIds.size() + 1);
+        offsets.push_back(0);
+        for (uint32_t id : usedIds) {
+            header.nameBytes += skuDictionary().name(id).size();
+            offsets.push_back(header.nameBytes);
         }
-        ItemNode* newNode = new ItemNode(itemName, qty);;
-        newNode->next = top;
-        top = newNode;
-    }
 
-    string pop() {
-    if (isEmpty()) {
-        throw runtime_error("No items in inventory to process!");
+        string buffer;
+        buffer.reserve(sizeof(header) + (1 + offsets.size()) * sizeof(uint64_t) + header.nameBytes + 8
+                       + records.size() * sizeof(SnapshotRecord));
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        buffer.append(reinterpret_cast<const char*>(&queueCount), sizeof(queueCount));
+        buffer.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        for (uint32_t id : usedIds) {
+            buffer += skuDictionary().name(id);
+        }
+        buffer.append(((header.nameBytes + 7) & ~uint64_t(7)) - header.nameBytes, '\0');
+        buffer.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SnapshotRecord));
+        return buffer;
     }
 
-    ItemNode* temp = top;
-    string name = temp->itemName;
-
-    if (temp->quantity > 1) {
-        temp->quantity--;
-    } else {
-        top = top->next;
-        delete temp;
+    // Write snapshotImage to a temporary file and swap it in; buffered
+    // journal records must be flushed first
+    void writeSnapshotFile(const string& filename) const {
+        string buffer = snapshotImage();
+        string tmp = filename + ".tmp";
+        ofstream outfile(tmp, ios::binary);
+        if (!outfile) {
+            throw runtime_error("Error: Could not open file for writing!");
+        }
+        outfile.write(buffer.data(), buffer.size());
+        outfile.close();
+        if (!outfile) {
+            throw runtime_error("Error: Could not write " + tmp);
+        }
+        commitFile(tmp, filename);
     }
 
-    return name;}
-
-
-    string peek() const {
-         if (isEmpty()) {
-            throw runtime_error("No incoming items.");
+    // Hand the records journaled since the last checkpoint to the writer
+    // thread, which replays them into its replica and writes both files from
+    // there. The journal is flushed first so the checkpoint never covers
+    // records that are not on disk yet.
+    void startCheckpoint() {
+        try {
+            journal.flush();
+            checkpointGeneration = journal.generation();
+            checkpointOffset = journal.size();
+            lastCheckpoint = chrono::steady_clock::now();
+            checkpoints.begin(journalTail, checkpointGeneration, checkpointOffset);
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
         }
-        return top->itemName;
     }
 
-    void displayAll() const {
-    if (isEmpty()) {
-        cout << "Inventory is empty." << endl;
-        return;
-    }
-    cout << "Inventory items (top to bottom): ";
-    ItemNode* current = top;
-    while (current != nullptr) {
-        cout << current->itemName <<  "(" << current->quantity << ") ";
-        current = current->next;
+    // Collect a finished checkpoint, blocking until it ends if wait is set
+    void pollCheckpoint(bool wait) {
+        bool written = false;
+        if (!checkpoints.collect(wait, written)) return;
+        if (!written) {
+            cout << "Checkpoint to " << checkpointSnapshot << " failed." << endl;
+            checkpointGeneration = checkpointOffset = 0;  // retry at the next interval
+            return;
+        }
+        try {
+            checkpointDone();
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+        }
     }
-    cout << endl;
-}
 
-};
-
-// Queue class for outgoing shipments (FIFO)
-class ShippingQueue {
-private:
-    ItemNode* front;
-    ItemNode* rear;
-
-public:
-
-    ItemNode* getFront() const { return front; }
-
-    void setFront(ItemNode* node) { front = node; }
-
-    ShippingQueue() : front(nullptr), rear(nullptr) {}
-
-    ~ShippingQueue() {
-        while (!isEmpty()) {
-            dequeue();
+    // The snapshot on disk now covers the journal up to checkpointOffset:
+    // carry only the records after it into the next journal generation
+    void checkpointDone() {
+        if (journal.isOpen() && journal.generation() == checkpointGeneration) {
+            journal.restart(checkpointGeneration + 1, checkpointOffset);
+            checkpointGeneration = journal.generation();
+            checkpointOffset = journal.size();
         }
     }
 
-    bool isEmpty() const {
-        return front == nullptr;
+    // Push the parsed blocks of one chunk in input order and journal them
+    // as one group
+    void applyReceipts(vector<future<ReceiptBlock>>& blocks, size_t& lineBase, ImportStats& stats) {
+        string records;
+        for (auto& pending : blocks) {
+            ReceiptBlock block = pending.get();
+            for (const ReceiptRow& row : block.rows) {
+                inventory.push(skuDictionary().intern(string(row.name, row.length)), row.qty);
+            }
+            records += block.records;
+            stats.rows += block.rows.size();
+            if (block.rejected > 0 && stats.rejected == 0) {
+                stats.firstRejected = lineBase + block.firstRejected;
+            }
+            stats.rejected += block.rejected;
+            lineBase += block.lines;
+        }
+        blocks.clear();
+        journal.recordBatch(records);
     }
 
-    void enqueue(string itemName,int qty = 1) {
-    if (!isEmpty() && rear->itemName == itemName) {
-        rear->quantity += qty;
-        return;
-    }
-    ItemNode* newNode = new ItemNode(itemName, qty);
-    if (isEmpty()) {
-        front = rear = newNode;
-    } else {
-        rear->next = newNode;
-        rear = newNode;
+    // Take one unit of an item, from the inventory first, as removeItem does
+    void removeOne(uint32_t itemId) {
+        if (inventory.quantityOf(itemId) > 0) {
+            inventory.take(itemId, 1);
+        } else if (shipping.quantityOf(itemId) > 0) {
+            shipping.take(itemId, 1);
+        }
     }
-}
 
-    string dequeue() {
-        if (isEmpty()) {
-            throw runtime_error("No items to ship.!");
-        }
+public:
+    WarehouseSystem()
+        : inventory(pool), shipping(pool), snapshotGeneration(0), snapshotOffset(0),
+          checkpointInterval(0), checkpointGeneration(0), checkpointOffset(0) {
+    }
 
-        ItemNode* temp = front;
-        string name = temp->itemName;
+    ~WarehouseSystem() {
+        finishCheckpoint();
+    }
 
-        if (temp->quantity > 1) {
-        temp->quantity--;
-    } else {
-        front = front->next;
-        if (front == nullptr) rear = nullptr;
-        delete temp;
+    // Checkpoint to these files from checkpointIfDue, at most once per
+    // interval. Needs the journal open, since the checkpoint writer follows
+    // the warehouse through its records; call once.
+    void enableCheckpoints(const string& textFile, const string& snapshotFile,
+                           chrono::steady_clock::duration interval) {
+        if (!journal.isOpen() || checkpoints.started()) return;
+        checkpointText = textFile;
+        checkpointSnapshot = snapshotFile;
+        checkpointInterval = interval;
+        lastCheckpoint = chrono::steady_clock::now();
+        checkpoints.start(snapshotImage(), textFile, snapshotFile);
+        journal.tap(&journalTail);
     }
 
-    return name;
+    // Call between commands: reaps a finished checkpoint and starts the next
+    // one once the interval has passed and the journal has grown since
+    void checkpointIfDue() {
+        pollCheckpoint(false);
+        if (checkpointText.empty() || !journal.isOpen() || checkpoints.running()) return;
+        if (chrono::steady_clock::now() - lastCheckpoint < checkpointInterval) return;
+        if (journal.generation() == checkpointGeneration && journal.size() == checkpointOffset) return;
+        startCheckpoint();
     }
 
+    // Wait for a running checkpoint; call before writing its files directly
+    void finishCheckpoint() {
+        pollCheckpoint(true);
+    }
 
-    string peek() const {
-        if (isEmpty()) {
-            throw runtime_error("No items in shipping queue.");
+    // Write out journal records held back by the group policy
+    void flushJournal() {
+        try {
+            journal.flush();
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
         }
-        return front->itemName;
     }
 
-    void displayAll() const {
-    if (isEmpty()) {
-        cout << "Shipping queue is empty." << endl;
-        return;
-    }
-    cout << "Shipping queue items (front to rear): ";
-    ItemNode* current = front;
-    while (current != nullptr) {
-        cout << current->itemName <<  "(" << current->quantity << ") ";
-        current = current->next;
-    }
-    cout << endl;
-}
+    const NodePool& nodePool() const { return pool; }
 
-};
-
-// Warehouse System
-class WarehouseSystem {
-private:
-    InventoryStack inventory;
-    ShippingQueue shipping;
+    // Empty both containers and hand the node slabs back in one go
+    void clear() {
+        inventory.clear();
+        shipping.clear();
+        pool.releaseAll();
+    }
 
-public:
+    // False if the file is there but could not be read, in which case the
+    // warehouse is left as it was
+    bool loadFromFile(const string& filename) {
+    NameFolds folds;
+    MappedFile snapshot;
+    if (snapshot.open(filename) && snapshot.size() >= sizeof(SNAPSHOT_MAGIC)
+            && memcmp(snapshot.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0) {
+        try {
+            loadSnapshot(snapshot.data(), snapshot.size(), folds);
+        } catch (const runtime_error& e) {
+            cout << e.what() << endl;
+            return false;
+        }
+        cout << "Previous data loaded from " << filename << endl;
+        folds.report(filename);
+        return true;
+    }
 
-    void loadFromFile(const string& filename) {
     ifstream infile(filename);
 
     if (!infile) {
         cout << "No previous save found. Starting fresh." << endl;
-        return;
+        return true;
     }
 
     string line;
     bool loadingInventory = false;
     bool loadingShipping = false;
+    bool withQuantities = false;
+    // Runs are collected first so a bad line leaves the containers untouched
+    vector<pair<uint32_t, int>> stackRuns;
+    vector<pair<uint32_t, int>> queueRuns;
+
+    if (getline(infile, line) && line == TEXT_SAVE_HEADER) {
+        withQuantities = true;
+    } else {
+        infile.clear();
+        infile.seekg(0);
+    }
 
     while (getline(infile, line)) {
         if (line.find("--- Final Inventory ---") != string::npos) {
@@ -204,22 +371,202 @@ public:
             continue;
         }
 
-        if (loadingInventory && line != "Inventory is empty.") {
-            // Push onto stack (LIFO)
-            inventory.push(line);
-        }
-        if (loadingShipping && line != "Shipping queue is empty.") {
-            // Enqueue into queue (FIFO)
-            shipping.enqueue(line);
+        if (!loadingInventory && !loadingShipping) continue;
+        if (line == "Inventory is empty." || line == "Shipping queue is empty.") continue;
+
+        pair<uint32_t, int> run(0, 1);
+        if (withQuantities) {
+            size_t tab = line.find('\t');
+            char* end = nullptr;
+            long qty = strtol(line.c_str(), &end, 10);
+            if (tab == string::npos || end != line.c_str() + tab || qty <= 0 || qty > numeric_limits<int>::max()) {
+                cout << "Error: Malformed line in " << filename << ": " << line << endl;
+                return false;
+            }
+            run = {folds.intern(line.substr(tab + 1)), static_cast<int>(qty)};
+        } else {
+            // Older saves hold one unit per line
+            run.first = folds.intern(line);
         }
+        (loadingInventory ? stackRuns : queueRuns).push_back(run);
     }
 
     infile.close();
+    // The file lists the stack top to bottom, so push it in reverse
+    for (auto it = stackRuns.rbegin(); it != stackRuns.rend(); ++it) {
+        inventory.push(it->first, it->second);
+    }
+    for (const auto& run : queueRuns) {
+        shipping.enqueue(run.first, run.second);
+    }
     cout << "Previous data loaded from " << filename << endl;
+    folds.report(filename);
+    return true;
 }
 
+    // Rebuild both containers from a binary snapshot in one pass
+    void loadSnapshot(const char* base, size_t size, NameFolds& folds) {
+        SnapshotHeader header = SnapshotHeader();
+        if (size < SNAPSHOT_HEADER_SIZES[1]) {
+            throw runtime_error("Snapshot is truncated.");
+        }
+        memcpy(&header, base, SNAPSHOT_HEADER_SIZES[1]);
+        if (header.version < 1 || header.version > SNAPSHOT_VERSION || size < SNAPSHOT_HEADER_SIZES[header.version]) {
+            throw runtime_error("Unsupported snapshot version " + to_string(header.version) + ".");
+        }
+        // Fields a version lacks keep their zero defaults
+        size_t headerSize = SNAPSHOT_HEADER_SIZES[header.version];
+        memcpy(&header, base, headerSize);
+        // This build ships from one FIFO queue and keeps no lots
+        if (header.version < 3) header.dockCount = 1;
+        if (header.dockCount != 1 || header.priorityCount != 0 || header.termsCount != 0
+                || header.priorityShipping != 0 || header.lotCount != 0) {
+            throw runtime_error("Snapshot holds lots, docks or priority shipping, which this build does not support.");
+        }
+
+        uint64_t countsSize = header.version < 3 ? 0 : sizeof(uint64_t);
+        uint64_t offsetsSize = (uint64_t(header.nameCount) + 1) * sizeof(uint64_t);
+        uint64_t namesSize = (header.nameBytes + 7) & ~uint64_t(7);
+        uint64_t expected = headerSize + countsSize + offsetsSize + namesSize
+                          + (header.stackCount + header.queueCount) * sizeof(SnapshotRecord);
+        if (header.nameBytes > size || header.stackCount > size || header.queueCount > size
+                || expected != size) {
+            throw runtime_error("Snapshot is truncated or corrupt.");
+        }
+        if (header.version >= 3) {
+            uint64_t queueCount;
+            memcpy(&queueCount, base + headerSize, sizeof(queueCount));
+            if (queueCount != header.queueCount) throw runtime_error("Snapshot is truncated or corrupt.");
+        }
+
+        const char* offsets = base + headerSize + countsSize;
+        const char* names = offsets + offsetsSize;
+        const char* records = names + namesSize;
+
+        // Check the name table and every record before touching the
+        // containers, so a corrupt file leaves the warehouse as it was
+        for (uint32_t i = 0; i < header.nameCount; i++) {
+            uint64_t begin;
+            uint64_t end;
+            memcpy(&begin, offsets + i * sizeof(uint64_t), sizeof(begin));
+            memcpy(&end, offsets + (i + 1) * sizeof(uint64_t), sizeof(end));
+            if (begin > end || end > header.nameBytes) {
+                throw runtime_error("Snapshot name table is corrupt.");
+            }
+        }
+        for (uint64_t i = 0; i < header.stackCount + header.queueCount; i++) {
+            SnapshotRecord r;
+            memcpy(&r, records + i * sizeof(r), sizeof(r));
+            if (r.nameId >= header.nameCount || r.quantity <= 0) {
+                throw runtime_error("Snapshot record is corrupt.");
+            }
+        }
+
+        // Map the snapshot's name table onto the live dictionary
+        vector<uint32_t> ids(header.nameCount);
+        for (uint32_t i = 0; i < header.nameCount; i++) {
+            uint64_t begin;
+            uint64_t end;
+            memcpy(&begin, offsets + i * sizeof(uint64_t), sizeof(begin));
+            memcpy(&end, offsets + (i + 1) * sizeof(uint64_t), sizeof(end));
+            ids[i] = folds.intern(string(names + begin, names + end));
+        }
+
+        // Stack records run top to bottom, so push them in reverse
+        for (uint64_t i = header.stackCount; i > 0; i--) {
+            SnapshotRecord r;
+            memcpy(&r, records + (i - 1) * sizeof(r), sizeof(r));
+            inventory.push(ids[r.nameId], r.quantity);
+        }
+        records += header.stackCount * sizeof(SnapshotRecord);
+        for (uint64_t i = 0; i < header.queueCount; i++) {
+            SnapshotRecord r;
+            memcpy(&r, records + i * sizeof(r), sizeof(r));
+            shipping.enqueue(ids[r.nameId], r.quantity);
+        }
+        snapshotGeneration = header.journalGeneration;
+        snapshotOffset = header.journalOffset;
+    }
+
+    // Add every valid row of a CSV/TSV receipts file to the inventory in
+    // file order. Chunks are parsed on up to `threads` workers (0: one per
+    // core) while the previous chunk is applied; a first line without a
+    // numeric quantity is taken as a header.
+    ImportStats importReceipts(const string& filename, unsigned threads = 0) {
+        ifstream infile(filename, ios::binary);
+        if (!infile) {
+            throw runtime_error("Could not open " + filename);
+        }
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+
+        ImportStats stats;
+        auto started = chrono::steady_clock::now();
+        vector<char> chunk;
+        vector<char> parsedChunk;  // keeps the rows of `parsing` alive
+        vector<future<ReceiptBlock>> parsing;
+        string carry;              // partial last line of the previous chunk
+        size_t lineBase = 0;
+        bool firstChunk = true;
+
+        while (true) {
+            chunk.assign(carry.begin(), carry.end());
+            size_t have = chunk.size();
+            chunk.resize(have + IMPORT_CHUNK_BYTES);
+            infile.read(chunk.data() + have, IMPORT_CHUNK_BYTES);
+            size_t got = static_cast<size_t>(infile.gcount());
+            stats.bytes += got;
+            chunk.resize(have + got);
+            bool last = got < IMPORT_CHUNK_BYTES;
+
+            size_t end = chunk.size();
+            carry.clear();
+            if (!last) {
+                size_t cut = end;
+                while (cut > 0 && chunk[cut - 1] != '\n') cut--;
+                carry.assign(chunk.begin() + cut, chunk.end());
+                end = cut;
+            }
+
+            char* base = chunk.data();
+            size_t start = 0;
+            if (firstChunk && end > 0) {
+                const char* eol = static_cast<const char*>(memchr(base, '\n', end));
+                size_t lineEnd = eol == nullptr ? end : eol - base;
+                size_t trimmed = lineEnd > 0 && base[lineEnd - 1] == '\r' ? lineEnd - 1 : lineEnd;
+                size_t sep = trimmed;
+                while (sep > 0 && base[sep - 1] != ',' && base[sep - 1] != '\t') sep--;
+                int qty;
+                if (sep > 0 && !parseQuantity(base + sep, base + trimmed, qty)) {
+                    start = eol == nullptr ? end : lineEnd + 1;
+                    lineBase = 1;
+                }
+                firstChunk = false;
+            }
+
+            // Line-aligned blocks, one per worker
+            vector<future<ReceiptBlock>> blocks;
+            size_t blockSize = (end - start) / threads + 1;
+            while (start < end) {
+                size_t stop = min(end, start + blockSize);
+                while (stop < end && base[stop - 1] != '\n') stop++;
+                blocks.push_back(async(launch::async, parseReceiptBlock, base + start, base + stop, journal.isOpen()));
+                start = stop;
+            }
+
+            applyReceipts(parsing, lineBase, stats);
+            parsing = move(blocks);
+            swap(parsedChunk, chunk);
+            if (last) break;
+        }
+        applyReceipts(parsing, lineBase, stats);
+
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return stats;
+    }
+
     void addItem(string itemName,int qty) {
-        inventory.push(itemName,qty);
+        inventory.push(skuDictionary().intern(itemName),qty);
+        journal.record("A " + to_string(qty) + " " + itemName);
          cout << "Item \"" << itemName << "\" added to inventory. Quantity: " << qty << endl;
     }
 
@@ -227,59 +574,65 @@ public:
     void processItem(const string& itemName, int qty) {
         try {
             // Find item in inventory
-            ItemNode* cur = inventory.getTop();
-            while (cur != nullptr) {
-                if (cur->itemName == itemName) {
-                    if (cur->quantity < qty) {
-                        cout << "Not enough quantity in inventory to process!" << endl;
-                        return;
-                    }
-                    cur->quantity -= qty;
-                    if (cur->quantity == 0) {
-                        // Remove node
-                        inventory.setTop(cur->next);
-                        delete cur;
-                    }
-                    shipping.enqueue(itemName, qty);
-                    cout << "Processed \"" << itemName << "\" (" << qty << ") and added to shipping queue." << endl;
-                    return;
-                }
-                cur = cur->next;
+            uint32_t itemId = skuDictionary().lookup(itemName);
+            int stocked = inventory.quantityOf(itemId);
+            if (stocked == 0) {
+                cout << "Item not found in inventory: " << itemName << endl;
+                return;
+            }
+            if (stocked < qty) {
+                cout << "Not enough quantity in inventory to process!" << endl;
+                return;
             }
-            cout << "Item not found in inventory: " << itemName << endl;
+            moveToShipping(itemId, qty);
+            journal.record("p " + to_string(qty) + " " + itemName);
+            cout << "Processed \"" << itemName << "\" (" << qty << ") and added to shipping queue." << endl;
         } catch (const runtime_error& e) {
             cout << e.what() << endl;
         }
     }
 
+    // Reserve a customer order: move every line from inventory to the
+    // shipping queue, or none of them if any line cannot be met. The order
+    // is journaled as one record, so a crash cannot leave it half-applied.
+    bool reserveOrder(const vector<OrderLine>& lines) {
+        vector<pair<uint32_t, int>> merged;
+        string reason;
+        if (!checkOrder(lines, merged, reason)) {
+            cout << "Order rejected: " << reason << endl;
+            return false;
+        }
+        string record = "O " + to_string(merged.size()) + " ";
+        long long units = 0;
+        for (size_t i = 0; i < merged.size(); i++) {
+            moveToShipping(merged[i].first, merged[i].second);
+            if (i > 0) record += '\t';
+            record += to_string(merged[i].second) + " " + skuDictionary().name(merged[i].first);
+            units += merged[i].second;
+        }
+        journal.record(record);
+        cout << "Order reserved: " << merged.size() << " item(s), " << units
+             << " unit(s) added to shipping queue." << endl;
+        return true;
+    }
+
     // Modified shipItem to accept item name and quantity
     void shipItem(const string& itemName, int qty) {
         try {
-            ItemNode* cur = shipping.getFront();
-            ItemNode* prev = nullptr;
-            while (cur != nullptr) {
-                if (cur->itemName == itemName) {
-                    if (cur->quantity < qty) {
-                        cout << "Not enough quantity in shipping queue to ship!" << endl;
-                        return;
-                    }
-                    cur->quantity -= qty;
-                    cout << "Shipping item: " << itemName << " (" << qty << ")" << endl;
-                    if (cur->quantity == 0) {
-                        // Remove node
-                        if (prev == nullptr) {
-                            shipping.setFront(cur->next);
-                        } else {
-                            prev->next = cur->next;
-                        }
-                        delete cur;
-                    }
-                    return;
-                }
-                prev = cur;
-                cur = cur->next;
+            uint32_t itemId = skuDictionary().lookup(itemName);
+            int queued = shipping.quantityOf(itemId);
+            if (queued == 0) {
+                cout << "Item not found in shipping queue: " << itemName << endl;
+                return;
+            }
+            if (queued < qty) {
+                cout << "Not enough quantity in shipping queue to ship!" << endl;
+                return;
             }
-            cout << "Item not found in shipping queue: " << itemName << endl;
+            // Removes the entry once it runs out
+            shipping.take(itemId, qty);
+            journal.record("s " + to_string(qty) + " " + itemName);
+            cout << "Shipping item: " << itemName << " (" << qty << ")" << endl;
         } catch (const runtime_error& e) {
             cout << e.what() << endl;
         }
@@ -287,7 +640,7 @@ public:
 
     void viewLastIncoming() const {
          try {
-            cout << "Last incoming item: " << inventory.peek() << endl;
+            cout << "Last incoming item: " << skuDictionary().name(inventory.peek()) << endl;
         } catch (const runtime_error& e) {
             cout << e.what() << endl;
         }
@@ -295,7 +648,7 @@ public:
 
     void viewNextShipment() const {
         try {
-            cout << "Next item to ship: " << shipping.peek() << endl;
+            cout << "Next item to ship: " << skuDictionary().name(shipping.peek()) << endl;
         } catch (const runtime_error& e) {
             cout << e.what() << endl;
         }
@@ -311,26 +664,22 @@ public:
 // Search for an item in Inventory Stack and Shipping Queue
 void searchItem(const string& name) const {
     try {
+        uint32_t id = skuDictionary().lookup(name);
+
          // Search in Inventory (stack)
-        ItemNode* cur = inventory.getTop();
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                cout << "Found in Inventory: " << name
-                     << " (" << cur->quantity << ")" << endl;
-                return;// Stop once found
-            }
-            cur = cur->next;// Move to next node
+        int stocked = inventory.quantityOf(id);
+        if (stocked > 0) {
+            cout << "Found in Inventory: " << name
+                 << " (" << stocked << ")" << endl;
+            return;// Stop once found
         }
 
         // Search in Shipping Queue
-        cur = shipping.getFront();
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                cout << "Found in Shipping Queue: " << name
-                     << " (" << cur->quantity << ")" << endl;
-                return;// Stop once found
-            }
-            cur = cur->next;
+        int queued = shipping.quantityOf(id);
+        if (queued > 0) {
+            cout << "Found in Shipping Queue: " << name
+                 << " (" << queued << ")" << endl;
+            return;// Stop once found
         }
 
         // If not found in both structures, throw error
@@ -346,63 +695,26 @@ void searchItem(const string& name) const {
 // Remove an item by name (from Inventory or Shipping Queue)
 void removeItem(const string& name) {
     try {
+        uint32_t id = skuDictionary().lookup(name);
 
         // Search in Inventory (stack)
-        ItemNode* cur = inventory.getTop();
-        ItemNode* prev = nullptr;
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                if (cur->quantity > 1) {
-
-                    // If quantity > 1, just decrease by 1
-                    cur->quantity--;
-                } else {
+        if (inventory.quantityOf(id) > 0) {
 
-                    // If only one item, remove node completely
-                    if (prev == nullptr) {
-
-                        // Remove top node
-                        inventory.setTop(cur->next);
-                    } else {
-
-                        // Bypass the current node
-                        prev->next = cur->next;
-                    }
-                    delete cur;
-                }
-                cout << "Removed \"" << name << "\" from Inventory." << endl;
-                return;
-            }
-            prev = cur;// Keep track of previous node
-            cur = cur->next; // Move to next node
+            // Takes one unit, removing the entry once it runs out
+            inventory.take(id, 1);
+            journal.record("R " + name);
+            cout << "Removed \"" << name << "\" from Inventory." << endl;
+            return;
         }
 
         // Search in Shipping Queue
-        cur = shipping.getFront();
-        prev = nullptr;
-        while (cur != nullptr) {
-            if (cur->itemName == name) {
-                if (cur->quantity > 1) {
-
-                    // If quantity > 1, just decrease by 1
-                    cur->quantity--;
-                } else {
-
-                     // If only one item, remove node completely
-                    if (prev == nullptr) {
+        if (shipping.quantityOf(id) > 0) {
 
-                         // Remove front node
-                        shipping.setFront(cur->next);
-                    } else {
-                        prev->next = cur->next;
-                    }
-                    delete cur;
-                }
-                cout << "Removed \"" << name << "\" from Shipping Queue." << endl;
-                return;
-            }
-            prev = cur;
-            cur = cur->next;
+            // Takes one unit, removing the entry once it runs out
+            shipping.take(id, 1);
+            journal.record("R " + name);
+            cout << "Removed \"" << name << "\" from Shipping Queue." << endl;
+            return;
         }
 
         throw runtime_error("Item not found: " + name);
@@ -414,93 +726,229 @@ void removeItem(const string& name) {
 
 // Count total items (Inventory + Shipping Queue)
 void countItems() const {
-    int count = 0;
+#ifdef WAREHOUSE_DEBUG
+    verifyCounts();
+#endif
+    long long count = inventory.unitCount() + shipping.unitCount();
+    cout << "Total items in system: " << count << endl;
+}
 
-    // Count items in Inventory (stack)
-    ItemNode* cur = inventory.getTop();
-    while (cur != nullptr) {
-        count += cur->quantity;
-        cur = cur->next;
+// Cross-check the running totals of both containers against a full scan
+void verifyCounts() const {
+    long long units = 0;
+    size_t entries = 0;
+    for (const auto& entry : inventory) {
+        units += entry.quantity;
+        entries++;
+    }
+    if (units != inventory.unitCount() || entries != inventory.entryCount()) {
+        throw logic_error("Inventory counters out of sync with its contents");
     }
 
-    // Count items in Shipping Queue
-    cur = shipping.getFront();
-    while (cur != nullptr) {
-        count += cur->quantity;
-        cur = cur->next;
+    units = 0;
+    entries = 0;
+    for (const auto& entry : shipping) {
+        units += entry.quantity;
+        entries++;
+    }
+    if (units != shipping.unitCount() || entries != shipping.entryCount()) {
+        throw logic_error("Shipping queue counters out of sync with its contents");
     }
-    cout << "Total items in system: " << count << endl;
 }
 
-
 void saveToFile(const string& filename) const {
-    ofstream outfile(filename);
+    try {
+        writeTextFile(filename);
+        cout << "Final result saved to " << filename << endl;
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
 
-    if (!outfile) {
-        cout << "Error: Could not open file for writing!" << endl;
-        return;
+// Write both containers as a binary snapshot (see SnapshotHeader)
+void saveSnapshot(const string& filename) {
+    try {
+        journal.flush();
+        writeSnapshotFile(filename);
+        cout << "Snapshot saved to " << filename << endl;
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
     }
+}
 
-    outfile << "--- Final Inventory ---" << endl;
-    if (inventory.isEmpty()) {
-        outfile << "Inventory is empty." << endl;
-    } else {
-        ItemNode* current = inventory.getTop();  // need access
-        while (current != nullptr) {
-            outfile << current->itemName << endl;
-            current = current->next;
+// Open the journal, first replaying whatever it holds beyond the loaded
+// snapshot. A journal that does not continue from that snapshot is
+// discarded and a new generation is started.
+void openJournal(const string& filename, const JournalPolicy& policy = JournalPolicy()) {
+    ifstream infile(filename, ios::binary);
+    string header;
+    uint64_t generation = 0;
+    bool usable = false;
+    if (infile && getline(infile, header) && header.compare(0, 10, "WHJOURNAL ") == 0) {
+        generation = strtoull(header.c_str() + 10, nullptr, 10);
+        if (generation == snapshotGeneration) {
+            // Same generation: the snapshot already holds the first part
+            infile.seekg(static_cast<streamoff>(snapshotOffset));
+            usable = true;
+        } else if (generation == snapshotGeneration + 1) {
+            usable = true;
         }
-    };
+    }
 
-    outfile << "--- Final Shipping Queue ---" << endl;
-    if (shipping.isEmpty()) {
-        outfile << "Shipping queue is empty." << endl;
-    } else {
-        ItemNode* current = shipping.getFront();  // need access
-        while (current != nullptr) {
-            outfile << current->itemName << endl;
-            current = current->next;
+    try {
+        if (usable) {
+            uint64_t validEnd = 0;
+            NameFolds folds;
+            size_t replayed = replayJournal(infile, validEnd, folds);
+            if (replayed > 0) {
+                cout << "Replayed " << replayed << " journaled operation(s) from " << filename << endl;
+            }
+            folds.report(filename);
+            infile.close();
+            // Drop a record torn by a crash so new records start on a clean line
+            if (validEnd != 0 && validEnd < filesystem::file_size(filename)) {
+                filesystem::resize_file(filename, validEnd);
+            }
+            journal.open(filename, generation, policy);
+        } else {
+            infile.close();
+            error_code ec;
+            bool stale = filesystem::file_size(filename, ec) > 0 && !ec;
+            if (stale) {
+                cout << "Journal " << filename << " does not match the loaded data; starting a new one." << endl;
+            }
+            journal.open(filename, snapshotGeneration + 1, policy);
+            if (stale) journal.restart(snapshotGeneration + 1);
+        }
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+// Re-apply journaled operations without printing. validEnd is set to the
+// offset just past the last complete record.
+size_t replayJournal(istream& in, uint64_t& validEnd, NameFolds& folds) {
+    size_t applied = 0;
+    string line;
+    streamoff start = in.tellg();
+    validEnd = start < 0 ? 0 : static_cast<uint64_t>(start);
+    while (getline(in, line)) {
+        if (in.eof()) break;  // no newline: torn by a crash mid-write
+        validEnd = static_cast<uint64_t>(in.tellg());
+        if (line.size() < 3 || line[1] != ' ') continue;
+
+        string rest = line.substr(2);
+        size_t space = rest.find(' ');
+        long long n = strtoll(rest.c_str(), nullptr, 10);
+        string name = space == string::npos ? "" : rest.substr(space + 1);
+        switch (line[0]) {
+            case 'A':
+                inventory.push(folds.intern(name), static_cast<int>(n));
+                break;
+            case 'p': {
+                uint32_t id = skuDictionary().lookup(canonicalItemName(name));
+                if (inventory.quantityOf(id) >= n) moveToShipping(id, static_cast<int>(n));
+                break;
+            }
+            case 's': {
+                uint32_t id = skuDictionary().lookup(canonicalItemName(name));
+                if (shipping.quantityOf(id) >= n) shipping.take(id, static_cast<int>(n));
+                break;
+            }
+            case 'R':
+                removeOne(skuDictionary().lookup(canonicalItemName(rest)));
+                break;
+            case 'O': {
+                // O items qty name<TAB>qty name...
+                vector<OrderLine> order;
+                size_t start = 0;
+                while (true) {
+                    size_t tab = name.find('\t', start);
+                    string field = name.substr(start, tab == string::npos ? string::npos : tab - start);
+                    size_t gap = field.find(' ');
+                    if (gap == string::npos) break;
+                    order.push_back({field.substr(gap + 1), atoi(field.c_str())});
+                    if (tab == string::npos) break;
+                    start = tab + 1;
+                }
+                vector<pair<uint32_t, int>> merged;
+                string reason;
+                if (order.size() != static_cast<size_t>(n) || !checkOrder(order, merged, reason)) continue;
+                for (const auto& item : merged) {
+                    moveToShipping(item.first, item.second);
+                }
+                break;
+            }
+            case 'U': {
+                size_t tab = name.find('\t');
+                if (tab == string::npos) continue;
+                uint32_t oldId = skuDictionary().lookup(canonicalItemName(name.substr(0, tab)));
+                uint32_t newId = folds.intern(name.substr(tab + 1));
+                inventory.reassign(oldId, newId, static_cast<int>(n));
+                shipping.reassign(oldId, newId, static_cast<int>(n));
+                break;
+            }
+            default:
+                continue;
         }
+        applied++;
     }
+    return applied;
+}
 
-    outfile.close();
-    cout << "Final result saved to " << filename << endl;
+// Load a snapshotImage taken from another warehouse, such as the one the
+// checkpoint writer restores its replica from
+void restoreImage(const string& image) {
+    NameFolds folds;
+    loadSnapshot(image.data(), image.size(), folds);
 }
 
+// Replay journal records into this warehouse and write both checkpoint
+// files from the result, stamped with the journal position it reaches
+void writeCheckpoint(const string& records, uint64_t generation, uint64_t offset,
+                     const string& textFile, const string& snapshotFile) {
+    istringstream in(records);
+    uint64_t validEnd = 0;
+    NameFolds folds;
+    replayJournal(in, validEnd, folds);
+    snapshotGeneration = generation;
+    snapshotOffset = offset;
+    writeTextFile(textFile);
+    writeSnapshotFile(snapshotFile);
+}
 
+// Start a fresh journal; call right after saveSnapshot, which covers
+// everything logged so far
+void resetJournal() {
+    if (!journal.isOpen()) return;
+    try {
+        journal.restart(journal.generation() + 1);
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
 
     // Update an item's name or quantity in Inventory or Shipping Queue
     void updateItem(const string& oldName, const string& newName, int newQty) {
         bool found = false;
+        uint32_t oldId = skuDictionary().lookup(oldName);
         // Update in Inventory
-        ItemNode* cur = inventory.getTop();
-        while (cur != nullptr) {
-            if (cur->itemName == oldName) {
-                cur->itemName = newName;
-                cur->quantity = newQty;
-                cout << "Updated item in Inventory: " << oldName << " -> " << newName
-                     << " (Qty: " << newQty << ")" << endl;
-                found = true;
-                break;
-            }
-            cur = cur->next;
+        if (inventory.reassign(oldId, skuDictionary().intern(newName), newQty)) {
+            cout << "Updated item in Inventory: " << oldName << " -> " << newName
+                 << " (Qty: " << newQty << ")" << endl;
+            found = true;
         }
         // Update in Shipping Queue
-        cur = shipping.getFront();
-        while (cur != nullptr) {
-            if (cur->itemName == oldName) {
-                cur->itemName = newName;
-                cur->quantity = newQty;
-                cout << "Updated item in Shipping Queue: " << oldName << " -> " << newName
-                     << " (Qty: " << newQty << ")" << endl;
-                found = true;
-                break;
-            }
-            cur = cur->next;
+        if (shipping.reassign(oldId, skuDictionary().intern(newName), newQty)) {
+            cout << "Updated item in Shipping Queue: " << oldName << " -> " << newName
+                 << " (Qty: " << newQty << ")" << endl;
+            found = true;
         }
         if (!found) {
             cout << "Item not found: " << oldName << endl;
+            return;
         }
+        journal.record("U " + to_string(newQty) + " " + oldName + "\t" + newName);
     }
 
 };
@@ -518,17 +966,30 @@ void displayWarehouseMenu() {
     cout << "8. Search Item\n";
     cout << "9. Count Items\n";
     cout << "10. Update Item\n"; // <-- Added menu option
-    cout << "11. Exit\n";
+    cout << "11. Reserve Order\n";
+    cout << "12. Exit\n";
     cout << "Enter your choice: ";
 }
 
+// Load the saved state and start journaling and checkpoints
+void loadWarehouse(WarehouseSystem& warehouse, const JournalPolicy& policy = JournalPolicy()) {
+    // Prefer the binary snapshot; result.txt stays as the plain-text copy
+    // and is read instead when the snapshot is rejected
+    if (!ifstream("result.snap") || !warehouse.loadFromFile("result.snap")) {
+        warehouse.loadFromFile("result.txt");
+    }
+    warehouse.openJournal("result.journal", policy);
+    warehouse.enableCheckpoints("result.txt", "result.snap", CHECKPOINT_INTERVAL);
+}
+
 // Function to run the Warehouse System
 void runWarehouseSystem() {
     WarehouseSystem warehouse;
-    warehouse.loadFromFile("result.txt");
+    loadWarehouse(warehouse);
     int choice;
 
     do {
+        warehouse.checkpointIfDue();
         displayWarehouseMenu();
         cin >> choice;
 
@@ -556,22 +1017,7 @@ void runWarehouseSystem() {
                     break;
                 }
                 try {
-                    bool onlySpaces = true;
-                    for (char c : itemName) {
-                        if (!isspace(c)) {
-                            onlySpaces = false;
-                            break;
-                        }
-                    }
-                    if (itemName.empty() || onlySpaces) {
-                        throw invalid_argument("Invalid item name! Cannot be empty or only spaces.");
-                    }
-                    for (char c : itemName) {
-                        if (!isalpha(c) && !isspace(c)) {
-                            throw invalid_argument("Invalid item name! Only letters are allowed.");
-                        }
-                    }
-                    warehouse.addItem(itemName, qty);
+                    warehouse.addItem(checkedItemName(itemName), qty);
                 } catch (const invalid_argument& e) {
                     cout << e.what() << endl;
                 }
@@ -591,7 +1037,11 @@ void runWarehouseSystem() {
                     cout << "Invalid quantity! Must be a positive integer." << endl;
                     break;
                 }
-                warehouse.processItem(itemName, qty);
+                try {
+                    warehouse.processItem(checkedItemName(itemName), qty);
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
                 break;
             }
             case 3: {
@@ -608,7 +1058,11 @@ void runWarehouseSystem() {
                     cout << "Invalid quantity! Must be a positive integer." << endl;
                     break;
                 }
-                warehouse.shipItem(itemName, qty);
+                try {
+                    warehouse.shipItem(checkedItemName(itemName), qty);
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
                 break;
             }
             case 4:
@@ -625,7 +1079,11 @@ void runWarehouseSystem() {
                 cout << "Enter item name to remove: ";
                 cin.ignore();
                 getline(cin, name);
-                warehouse.removeItem(name);
+                try {
+                    warehouse.removeItem(checkedItemName(name));
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
                 break;
             }
             case 8: {
@@ -633,7 +1091,11 @@ void runWarehouseSystem() {
                 cout << "Enter item name to search: ";
                 cin.ignore();
                 getline(cin, searchName);
-                warehouse.searchItem(searchName);
+                try {
+                    warehouse.searchItem(checkedItemName(searchName));
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
                 break;
             }
             case 9: {
@@ -656,20 +1118,291 @@ void runWarehouseSystem() {
                     cout << "Invalid quantity! Must be a positive integer." << endl;
                     break;
                 }
-                warehouse.updateItem(oldName, newName, newQty);
+                try {
+                    warehouse.updateItem(checkedItemName(oldName), checkedItemName(newName), newQty);
+                } catch (const invalid_argument& e) {
+                    cout << e.what() << endl;
+                }
+                break;
+            }
+            case 11: {
+                int lineCount;
+                cout << "Enter number of order lines: ";
+                cin >> lineCount;
+                if (cin.fail() || lineCount <= 0) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid number of lines! Must be a positive integer." << endl;
+                    break;
+                }
+                vector<OrderLine> order;
+                bool valid = true;
+                for (int i = 0; i < lineCount && valid; i++) {
+                    string itemName;
+                    int qty;
+                    cout << "Line " << i + 1 << " item name: ";
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    getline(cin, itemName);
+                    cout << "Line " << i + 1 << " quantity: ";
+                    cin >> qty;
+                    if (cin.fail() || qty <= 0) {
+                        cin.clear();
+                        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                        cout << "Invalid quantity! Must be a positive integer." << endl;
+                        valid = false;
+                        break;
+                    }
+                    try {
+                        order.push_back({checkedItemName(itemName), qty});
+                    } catch (const invalid_argument& e) {
+                        cout << e.what() << endl;
+                        valid = false;
+                    }
+                }
+                if (valid) warehouse.reserveOrder(order);
                 break;
             }
-            case 11:
+            case 12:
                 cout << "Exiting Warehouse System. Goodbye!" << endl;
-                warehouse.saveToFile("result.txt");
+                saveWarehouse(warehouse);
                 break;
             default:
                 cout << "Invalid choice! Please try again." << endl;
         }
-    } while (choice != 11);
+    } while (choice != 12);
 }
 
-int main() {
+// Batch commands, one per line; blank lines and lines starting with # are
+// skipped:
+//   add <qty> <name>            process <qty> <name>     ship <qty> <name>
+//   update <qty> <old>, <new>   remove <name>            search <name>
+//   count    view    last    next    import <file>    flush
+//   order <qty> <name>, <qty> <name>, ...  (all lines or none)
+// Output is buffered and written when the buffer fills, on "flush" and at
+// the end; the operation rate goes to stderr. path "-" reads stdin.
+int runBatch(const string& path) {
+    FILE* in = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        cerr << "Could not open " << path << endl;
+        return 1;
+    }
+    BatchOutput output(stdout);
+    streambuf* saved = cout.rdbuf(&output);
+
+    WarehouseSystem warehouse;
+    loadWarehouse(warehouse, BATCH_JOURNAL_POLICY);
+    BatchReader reader(in);
+    string_view line;
+    size_t lineNumber = 0;
+    size_t operations = 0;
+    auto started = chrono::steady_clock::now();
+
+    while (reader.next(line)) {
+        lineNumber++;
+        while (!line.empty() && line.front() == ' ') line.remove_prefix(1);
+        if (line.empty() || line.front() == '#') continue;
+        warehouse.checkpointIfDue();
+
+        string_view args = line;
+        string_view verb = nextWord(args);
+        long long count = 0;
+        operations++;
+        try {
+            if (verb == "add" || verb == "process" || verb == "ship") {
+                if (!parseCount(nextWord(args), count) || count > numeric_limits<int>::max()) {
+                    throw invalid_argument("Invalid quantity! Must be a positive integer.");
+                }
+                string name = checkedItemName(string(args));
+                if (verb == "add") {
+                    warehouse.addItem(name, static_cast<int>(count));
+                } else if (verb == "process") {
+                    warehouse.processItem(name, static_cast<int>(count));
+                } else {
+                    warehouse.shipItem(name, static_cast<int>(count));
+                }
+            } else if (verb == "update") {
+                if (!parseCount(nextWord(args), count) || count > numeric_limits<int>::max()) {
+                    throw invalid_argument("Invalid quantity! Must be a positive integer.");
+                }
+                size_t comma = args.find(',');
+                if (comma == string_view::npos) {
+                    throw invalid_argument("Usage: update <qty> <old name>, <new name>");
+                }
+                warehouse.updateItem(checkedItemName(string(args.substr(0, comma))),
+                                     checkedItemName(string(args.substr(comma + 1))), static_cast<int>(count));
+            } else if (verb == "order") {
+                vector<OrderLine> order;
+                while (!args.empty()) {
+                    size_t comma = args.find(',');
+                    string_view part = args.substr(0, comma);
+                    args = comma == string_view::npos ? string_view() : args.substr(comma + 1);
+                    while (!part.empty() && part.front() == ' ') part.remove_prefix(1);
+                    if (!parseCount(nextWord(part), count) || count > numeric_limits<int>::max()) {
+                        throw invalid_argument("Usage: order <qty> <name>, <qty> <name>, ...");
+                    }
+                    order.push_back({checkedItemName(string(part)), static_cast<int>(count)});
+                }
+                warehouse.reserveOrder(order);
+            } else if (verb == "remove") {
+                warehouse.removeItem(checkedItemName(string(args)));
+            } else if (verb == "search") {
+                warehouse.searchItem(checkedItemName(string(args)));
+            } else if (verb == "count") {
+                warehouse.countItems();
+            } else if (verb == "view") {
+                warehouse.viewAll();
+            } else if (verb == "last") {
+                warehouse.viewLastIncoming();
+            } else if (verb == "next") {
+                warehouse.viewNextShipment();
+            } else if (verb == "import") {
+                ImportStats stats = warehouse.importReceipts(string(args));
+                cout << "Imported " << stats.rows << " row(s) from " << args << endl;
+            } else if (verb == "flush") {
+                output.drain();
+            } else {
+                operations--;
+                cout << "line " << lineNumber << ": unknown command \"" << verb << "\"" << endl;
+            }
+        } catch (const exception& e) {
+            cout << "line " << lineNumber << ": " << e.what() << endl;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    saveWarehouse(warehouse);
+    if (in != stdin) fclose(in);
+    output.drain();
+    cout.rdbuf(saved);
+    cerr << operations << " operation(s) in " << seconds << " s ("
+         << static_cast<long long>(operations / max(seconds, 1e-9)) << " ops/s)" << endl;
+    return 0;
+}
+
+#ifdef __linux__
+// Run one request for runServer; its output becomes the response text
+bool executeRequest(WarehouseSystem& warehouse, ServerOp op, int64_t number, const string& name) {
+    switch (op) {
+        case OP_ADD:
+        case OP_PROCESS:
+        case OP_SHIP: {
+            if (number <= 0 || number > numeric_limits<int>::max()) {
+                throw invalid_argument("Invalid quantity! Must be a positive integer.");
+            }
+            string itemName = checkedItemName(name);
+            int qty = static_cast<int>(number);
+            if (op == OP_ADD) {
+                warehouse.addItem(itemName, qty);
+            } else if (op == OP_PROCESS) {
+                warehouse.processItem(itemName, qty);
+            } else {
+                warehouse.shipItem(itemName, qty);
+            }
+            return true;
+        }
+        case OP_SEARCH:
+            warehouse.searchItem(checkedItemName(name));
+            return true;
+        case OP_COUNT:
+            warehouse.countItems();
+            return true;
+        case OP_SNAPSHOT:
+            warehouse.finishCheckpoint();
+            warehouse.saveToFile("result.txt");
+            warehouse.saveSnapshot("result.snap");
+            warehouse.resetJournal();
+            return true;
+    }
+    cout << "Unknown request " << static_cast<int>(op) << endl;
+    return false;
+}
+#endif
+
+// Orders per second through reserveOrder, against the same orders sent as
+// one processItem call per line, at several order sizes. Every tenth order
+// ends with an item that is not stocked, which reserveOrder rejects whole.
+int runOrderBench(size_t orders) {
+    const size_t SKUS = 2000;
+    vector<string> names;
+    for (size_t i = 0; i < SKUS; i++) {
+        string name = "item ";
+        for (size_t k = i; ; k /= 26) {
+            name += static_cast<char>('a' + k % 26);
+            if (k < 26) break;
+        }
+        names.push_back(name);
+    }
+    mt19937 rng(1);
+
+    for (size_t lines : {10, 50, 100}) {
+        vector<vector<OrderLine>> batch(orders);
+        for (size_t o = 0; o < orders; o++) {
+            for (size_t l = 0; l < lines; l++) {
+                batch[o].push_back({names[rng() % SKUS], 1 + static_cast<int>(rng() % 5)});
+            }
+            if (o % 10 == 9) batch[o].back().name = "item unstocked";
+        }
+
+        double seconds[2];
+        size_t reserved = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            WarehouseSystem warehouse;
+            streambuf* saved = cout.rdbuf(nullptr);  // drop the per-order messages
+            for (const string& name : names) {
+                warehouse.addItem(name, 1 << 30);
+            }
+            auto started = chrono::steady_clock::now();
+            for (const auto& order : batch) {
+                if (pass == 0) {
+                    for (const OrderLine& line : order) {
+                        warehouse.processItem(line.name, line.quantity);
+                    }
+                } else {
+                    reserved += warehouse.reserveOrder(order);
+                }
+            }
+            seconds[pass] = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            cout.rdbuf(saved);
+            cout.clear();
+        }
+        cout << lines << " lines/order: per-line processItem "
+             << static_cast<long long>(orders / max(seconds[0], 1e-9)) << " orders/s, reserveOrder "
+             << static_cast<long long>(orders / max(seconds[1], 1e-9)) << " orders/s ("
+             << reserved << " reserved, " << orders - reserved << " rejected)" << endl;
+    }
+    return 0;
+}
+
+// warehouse                     interactive menu
+// warehouse --batch [file]      run commands from file (default stdin)
+// warehouse --serve <address>   serve a socket path or localhost TCP port
+// warehouse --loadgen <address> [connections] [requests] [pipeline]
+// warehouse --orders [orders]   all-or-nothing order reservation throughput
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && string(argv[1]) == "--batch") {
+        return runBatch(argc >= 3 ? argv[2] : "-");
+    }
+    if (argc >= 2 && string(argv[1]) == "--orders") {
+        size_t orders = 10000;
+        if (!countArgument(argc, argv, 2, orders)) return usage("--orders [orders]");
+        return runOrderBench(orders);
+    }
+#ifdef __linux__
+    if (argc >= 2 && string(argv[1]) == "--serve") {
+        if (!addressArgument(argc, argv, 2)) return usage("--serve <address>");
+        return runServer<WarehouseSystem>(argv[2]);
+    }
+    if (argc >= 2 && string(argv[1]) == "--loadgen") {
+        size_t connections = 4;
+        size_t requests = 100000;
+        size_t pipeline = 16;
+        if (!addressArgument(argc, argv, 2) || !countArgument(argc, argv, 3, connections)
+                || !countArgument(argc, argv, 4, requests) || !countArgument(argc, argv, 5, pipeline)) {
+            return usage("--loadgen <address> [connections] [requests] [pipeline]");
+        }
+        return runLoadgen(argv[2], connections, requests, pipeline);
+    }
+#endif
     runWarehouseSystem();
 
     return 0;